@@ -22,7 +22,7 @@ namespace BoardSpace {
 Board::Board()
     : bottomColor_{ PieceColor::RED }
     , pieces_{ std::make_shared<Pieces>() }
-    , seats_{ std::make_shared<Seats>() }
+    , seats_{ std::make_shared<Seats>(pieces_) }
 {
 }
 
@@ -90,7 +90,8 @@ void Board::changeSide(const ChangeType ct)
 const std::pair<std::shared_ptr<Seat>, std::shared_ptr<Seat>>
 Board::getMoveSeat(const std::wstring& zhStr) const
 {
-    assert(zhStr.size() == 4);
+    if (zhStr.size() != 4)
+        throw InstanceSpace::ParseError("中文着法不是4个字符");
     std::shared_ptr<Seat> fseat{}, tseat{};
     std::vector<std::shared_ptr<Seat>> seats{};
     // 根据最后一个字符判断该着法属于哪一方
@@ -102,7 +103,8 @@ Board::getMoveSeat(const std::wstring& zhStr) const
     if (PieceManager::isPiece(name)) { // 首字符为棋子名
         seats = seats_->getLiveSeats(color, name,
             PieceManager::getCol(isBottom, PieceManager::getNum(color, zhStr.at(1))));
-        assert(seats.size() > 0);
+        if (seats.empty())
+            throw InstanceSpace::ParseError("中文着法找不到棋子");
         //# 排除：士、象同列时不分前后，以进、退区分棋子。移动方向为退时，修正index
         index = (seats.size() == 2 && movDir == -1) ? 1 : 0; //&& isAdvBish(name)
     } else {
@@ -113,17 +115,23 @@ Board::getMoveSeat(const std::wstring& zhStr) const
         index = PieceManager::getIndex(seats.size(), isBottom, zhStr.front());
     }
 
-    assert(index <= static_cast<int>(seats.size()) - 1);
+    if (index < 0 || index >= static_cast<int>(seats.size()))
+        throw InstanceSpace::ParseError("中文着法找不到棋子");
     fseat = seats.at(index);
     int num{ PieceManager::getNum(color, zhStr.back()) },
         toCol{ PieceManager::getCol(isBottom, num) };
+    auto __getSeat = [&](const int row, const int col) {
+        if (row < 0 || row >= SeatManager::RowNum() || col < 0 || col >= SeatManager::ColNum())
+            throw InstanceSpace::ParseError("中文着法的目标位置超出棋盘");
+        return getSeat(row, col);
+    };
     if (PieceManager::isLineMove(name)) {
         int trow{ fseat->row() + movDir * num };
-        tseat = movDir == 0 ? getSeat(fseat->row(), toCol) : getSeat(trow, fseat->col());
+        tseat = movDir == 0 ? __getSeat(fseat->row(), toCol) : __getSeat(trow, fseat->col());
     } else { // 斜线走子：仕、相、马
         int colAway{ abs(toCol - fseat->col()) }, //  相距1或2列
             trow{ fseat->row() + movDir * (PieceManager::isAdvBish(name) ? colAway : (colAway == 1 ? 2 : 1)) };
-        tseat = getSeat(trow, toCol);
+        tseat = __getSeat(trow, toCol);
     }
     //assert(zhStr == getZh(fseat, tseat));
 
@@ -157,7 +165,8 @@ const std::wstring Board::getZhStr(const std::shared_ptr<Seat>& fseat,
                    : PieceManager::getColChar(color, isBottom, toCol));
 
     auto mvSeats = getMoveSeat(wss.str());
-    assert(fseat == mvSeats.first && tseat == mvSeats.second);
+    if (fseat != mvSeats.first || tseat != mvSeats.second) // 起止位置不合棋子走法
+        throw InstanceSpace::ParseError("着法不符合棋子走法");
 
     return wss.str();
 }
@@ -174,35 +183,47 @@ void Board::__setBottomSide()
             : PieceColor::BLACK);
 }
 
-const std::wstring Board::toString() const
+const std::wstring& Board::getTextBlankBoard()
 { // 文本空棋盘
-    std::wstring textBlankBoard{ L"┏━┯━┯━┯━┯━┯━┯━┯━┓\n"
-                                 "┃　│　│　│╲│╱│　│　│　┃\n"
-                                 "┠─┼─┼─┼─╳─┼─┼─┼─┨\n"
-                                 "┃　│　│　│╱│╲│　│　│　┃\n"
-                                 "┠─╬─┼─┼─┼─┼─┼─╬─┨\n"
-                                 "┃　│　│　│　│　│　│　│　┃\n"
-                                 "┠─┼─╬─┼─╬─┼─╬─┼─┨\n"
-                                 "┃　│　│　│　│　│　│　│　┃\n"
-                                 "┠─┴─┴─┴─┴─┴─┴─┴─┨\n"
-                                 "┃　　　　　　　　　　　　　　　┃\n"
-                                 "┠─┬─┬─┬─┬─┬─┬─┬─┨\n"
-                                 "┃　│　│　│　│　│　│　│　┃\n"
-                                 "┠─┼─╬─┼─╬─┼─╬─┼─┨\n"
-                                 "┃　│　│　│　│　│　│　│　┃\n"
-                                 "┠─╬─┼─┼─┼─┼─┼─╬─┨\n"
-                                 "┃　│　│　│╲│╱│　│　│　┃\n"
-                                 "┠─┼─┼─┼─╳─┼─┼─┼─┨\n"
-                                 "┃　│　│　│╱│╲│　│　│　┃\n"
-                                 "┗━┷━┷━┷━┷━┷━┷━┷━┛\n" }; // 边框粗线
+    static const std::wstring textBlankBoard{ L"┏━┯━┯━┯━┯━┯━┯━┯━┓\n"
+                                              "┃　│　│　│╲│╱│　│　│　┃\n"
+                                              "┠─┼─┼─┼─╳─┼─┼─┼─┨\n"
+                                              "┃　│　│　│╱│╲│　│　│　┃\n"
+                                              "┠─╬─┼─┼─┼─┼─┼─╬─┨\n"
+                                              "┃　│　│　│　│　│　│　│　┃\n"
+                                              "┠─┼─╬─┼─╬─┼─╬─┼─┨\n"
+                                              "┃　│　│　│　│　│　│　│　┃\n"
+                                              "┠─┴─┴─┴─┴─┴─┴─┴─┨\n"
+                                              "┃　　　　　　　　　　　　　　　┃\n"
+                                              "┠─┬─┬─┬─┬─┬─┬─┬─┨\n"
+                                              "┃　│　│　│　│　│　│　│　┃\n"
+                                              "┠─┼─╬─┼─╬─┼─╬─┼─┨\n"
+                                              "┃　│　│　│　│　│　│　│　┃\n"
+                                              "┠─╬─┼─┼─┼─┼─┼─╬─┨\n"
+                                              "┃　│　│　│╲│╱│　│　│　┃\n"
+                                              "┠─┼─┼─┼─╳─┼─┼─┼─┨\n"
+                                              "┃　│　│　│╱│╲│　│　│　┃\n"
+                                              "┗━┷━┷━┷━┷━┷━┷━┷━┛\n" }; // 边框粗线
+    return textBlankBoard;
+}
 
+// 只改写一个位置的字符，可反复用于同一文本棋盘
+void Board::putTextSeat(std::wstring& textBoard, const Seat& seat)
+{
+    int index{ (SeatManager::ColNum() - seat.row()) * 2 * (SeatManager::ColNum() * 2)
+        + seat.col() * 2 };
+    textBoard[index] = (seat.piece()
+            ? PieceManager::getPrintName(*seat.piece())
+            : getTextBlankBoard()[index]);
+}
+
+const std::wstring Board::toString() const
+{
+    std::wstring textBoard{ getTextBlankBoard() };
     for (auto color : { PieceColor::BLACK, PieceColor::RED })
         for (auto& seat : seats_->getLiveSeats(color))
-            textBlankBoard[(SeatManager::ColNum() - seat->row())
-                    * 2 * (SeatManager::ColNum() * 2)
-                + seat->col() * 2]
-                = PieceManager::getPrintName(*seat->piece());
-    return textBlankBoard;
+            putTextSeat(textBoard, *seat);
+    return textBoard;
 }
 
 const std::wstring Board::test()
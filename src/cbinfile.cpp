@@ -0,0 +1,248 @@
+#include "cbinfile.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+namespace InstanceSpace {
+
+static_assert(sizeof(CBinFormat::Block) == 12, "CBinFormat::Block must be 12 bytes");
+static_assert(sizeof(CBinFormat::Game) == 24, "CBinFormat::Game must be 24 bytes");
+static_assert(sizeof(CBinFormat::Footer) == 16, "CBinFormat::Footer must be 16 bytes");
+
+const std::uint16_t CBinFormat::version;
+const std::uint32_t CBinFormat::blockSize;
+
+static const size_t headerSize{ 8 }; // "CCCB"、版本号uint16、保留uint16
+static const size_t minMatch{ 4 };
+
+// 每个序列：标志字节(高4位字面量长度，低4位匹配长度-minMatch，取15时后续按255累加)
+//   字面量 | 匹配距离uint16 | 匹配长度延伸；最后一个序列只有字面量
+std::string CBinFormat::compress(const std::string& raw)
+{
+    const int hashBits{ 12 };
+    std::vector<int> table(1 << hashBits, -1);
+    size_t length{ raw.size() }, anchor{ 0 }, pos{ 0 };
+    std::string out{};
+    out.reserve(length / 2 + 16);
+
+    auto __read32 = [&](size_t index) {
+        std::uint32_t value{};
+        std::memcpy(&value, raw.data() + index, sizeof(value));
+        return value;
+    };
+    auto __putLength = [&](size_t len) {
+        for (; len >= 255; len -= 255)
+            out.push_back(static_cast<char>(255));
+        out.push_back(static_cast<char>(len));
+    };
+    auto __putSequence = [&](size_t matchLen, size_t distance) {
+        size_t litLen{ pos - anchor }, extLen{ matchLen > 0 ? matchLen - minMatch : 0 };
+        out.push_back(static_cast<char>((std::min<size_t>(litLen, 15) << 4) | std::min<size_t>(extLen, 15)));
+        if (litLen >= 15)
+            __putLength(litLen - 15);
+        out.append(raw, anchor, litLen);
+        if (matchLen == 0)
+            return;
+        out.push_back(static_cast<char>(distance & 0xFF));
+        out.push_back(static_cast<char>(distance >> 8));
+        if (extLen >= 15)
+            __putLength(extLen - 15);
+    };
+
+    while (pos + minMatch <= length) {
+        std::uint32_t value{ __read32(pos) };
+        int& entry = table[(value * 2654435761U) >> (32 - hashBits)];
+        int candidate{ entry };
+        entry = pos;
+        if (candidate < 0 || pos - candidate > 0xFFFF || __read32(candidate) != value) {
+            ++pos;
+            continue;
+        }
+        size_t matchLen{ minMatch };
+        while (pos + matchLen < length && raw[candidate + matchLen] == raw[pos + matchLen])
+            ++matchLen;
+        __putSequence(matchLen, pos - candidate);
+        pos += matchLen;
+        anchor = pos;
+    }
+    pos = length;
+    __putSequence(0, 0);
+    return out;
+}
+
+std::string CBinFormat::decompress(const char* data, size_t size, size_t rawSize)
+{
+    std::string out{};
+    out.reserve(rawSize);
+    const unsigned char *ip{ reinterpret_cast<const unsigned char*>(data) }, *end{ ip + size };
+    auto __getLength = [&](size_t len) {
+        if (len == 15)
+            for (unsigned char ch = 255; ch == 255;) {
+                if (ip == end)
+                    throw ParseError("CBIN压缩块不完整");
+                len += (ch = *ip++);
+            }
+        return len;
+    };
+
+    while (ip < end) {
+        unsigned char token{ *ip++ };
+        size_t litLen{ __getLength(token >> 4) };
+        if (litLen > static_cast<size_t>(end - ip) || out.size() + litLen > rawSize)
+            throw ParseError("CBIN压缩块有误");
+        out.append(reinterpret_cast<const char*>(ip), litLen);
+        ip += litLen;
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            throw ParseError("CBIN压缩块不完整");
+        size_t distance{ static_cast<size_t>(ip[0] | ip[1] << 8) };
+        ip += 2;
+        size_t matchLen{ __getLength(token & 0x0F) + minMatch };
+        if (distance == 0 || distance > out.size() || out.size() + matchLen > rawSize)
+            throw ParseError("CBIN压缩块有误");
+        // 匹配可与输出重叠，须逐字节复制
+        for (size_t from = out.size() - distance; matchLen > 0; --matchLen)
+            out.push_back(out[from++]);
+    }
+    if (out.size() != rawSize)
+        throw ParseError("CBIN压缩块长度不符");
+    return out;
+}
+
+Instance::CBinReader::CBinReader(const std::string& fileName)
+    : fileMap_{ fileName }
+{
+    __init();
+}
+
+Instance::CBinReader::CBinReader(const char* data, size_t size)
+    : fileMap_{ data, size }
+{
+    __init();
+}
+
+void Instance::CBinReader::__init()
+{
+    const char* data{ fileMap_.data() };
+    size_t size{ fileMap_.size() };
+    if (size < headerSize + sizeof(CBinFormat::Footer) || !std::equal(data, data + 4, "CCCB"))
+        throw ParseError("CBIN文件标记不是'CCCB'");
+    std::uint16_t version{};
+    std::memcpy(&version, data + 4, sizeof(version));
+    if (version != CBinFormat::version)
+        throw ParseError("CBIN文件版本不符");
+
+    // 文件尾及索引所在位置取决于压缩块的长度，不能直接按结构访问
+    std::memcpy(&footer_, data + size - sizeof(CBinFormat::Footer), sizeof(footer_));
+    if (!std::equal(footer_.magic, footer_.magic + 4, "CCCB")
+        || std::uint64_t{ footer_.indexOffset } + std::uint64_t{ footer_.blockCount } * sizeof(CBinFormat::Block)
+                + std::uint64_t{ footer_.gameCount } * sizeof(CBinFormat::Game) + sizeof(CBinFormat::Footer)
+            != size)
+        throw ParseError("CBIN文件尾与文件长度不符");
+    blocks_ = data + footer_.indexOffset;
+    games_ = blocks_ + footer_.blockCount * sizeof(CBinFormat::Block);
+}
+
+const CBinFormat::Game Instance::CBinReader::getGame(int gameNo) const
+{
+    CBinFormat::Game game{};
+    std::memcpy(&game, games_ + gameNo * sizeof(CBinFormat::Game), sizeof(game));
+    return game;
+}
+
+void Instance::CBinReader::toInstance(int gameNo, Instance& instance)
+{
+    if (gameNo < 0 || gameNo >= getGameCount())
+        throw ParseError("CBIN棋局序号超出范围");
+    const CBinFormat::Game game{ getGame(gameNo) };
+    if (game.block >= footer_.blockCount)
+        throw ParseError("CBIN棋局索引有误");
+    const std::string& block = __getBlock(game.block);
+    if (std::uint64_t{ game.offset } + game.size > block.size())
+        throw ParseError("CBIN棋局索引有误");
+
+    std::istringstream is{ block.substr(game.offset, game.size) };
+    instance.__reset();
+    instance.__readBIN(is);
+    instance.currentMove_ = instance.rootMove_;
+    instance.__setMoveZhStrAndNums();
+}
+
+const std::string& Instance::CBinReader::__getBlock(int blockNo)
+{
+    if (blockNo == cacheBlockNo_)
+        return cacheBlock_;
+    CBinFormat::Block block{};
+    std::memcpy(&block, blocks_ + blockNo * sizeof(CBinFormat::Block), sizeof(block));
+    if (std::uint64_t{ block.offset } + block.size > footer_.indexOffset)
+        throw ParseError("CBIN块索引有误");
+    const char* data{ fileMap_.data() + block.offset };
+    cacheBlock_ = (block.size == block.rawSize ? std::string(data, block.size)
+                                               : CBinFormat::decompress(data, block.size, block.rawSize));
+    cacheBlockNo_ = blockNo;
+    return cacheBlock_;
+}
+
+Instance::CBinWriter::CBinWriter(std::ostream& os)
+    : os_(os)
+{
+    char header[headerSize]{ 'C', 'C', 'C', 'B' };
+    std::memcpy(header + 4, &CBinFormat::version, sizeof(CBinFormat::version));
+    os_.write(header, headerSize);
+    offset_ = headerSize;
+}
+
+Instance::CBinWriter::~CBinWriter()
+{
+    close();
+}
+
+void Instance::CBinWriter::write(const Instance& instance)
+{
+    assert(!closed_);
+    std::ostringstream os{};
+    instance.__writeBIN(os);
+    std::string bin{ os.str() };
+    games_.push_back(CBinFormat::Game{ static_cast<std::uint32_t>(blocks_.size()),
+        static_cast<std::uint32_t>(block_.size()), static_cast<std::uint32_t>(bin.size()),
+        static_cast<std::uint32_t>(instance.getMovCount()), static_cast<std::uint32_t>(instance.getRemCount()),
+        static_cast<std::uint32_t>(instance.getRemLenMax()) });
+    block_ += bin;
+    if (block_.size() >= CBinFormat::blockSize)
+        __writeBlock();
+}
+
+void Instance::CBinWriter::close()
+{
+    if (closed_)
+        return;
+    if (!block_.empty())
+        __writeBlock();
+    CBinFormat::Footer footer{ offset_, static_cast<std::uint32_t>(blocks_.size()),
+        static_cast<std::uint32_t>(games_.size()), { 'C', 'C', 'C', 'B' } };
+    os_.write(reinterpret_cast<const char*>(blocks_.data()), blocks_.size() * sizeof(CBinFormat::Block));
+    os_.write(reinterpret_cast<const char*>(games_.data()), games_.size() * sizeof(CBinFormat::Game));
+    os_.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+    os_.flush();
+    closed_ = true;
+}
+
+void Instance::CBinWriter::__writeBlock()
+{
+    std::string data{ CBinFormat::compress(block_) };
+    if (data.size() >= block_.size())
+        data = block_;
+    // 块及索引的偏移以uint32保存，超出时已无法正确读回
+    if (std::uint64_t{ offset_ } + data.size() > std::numeric_limits<std::uint32_t>::max())
+        throw ParseError("CBIN文件超出4GB，偏移量无法保存");
+    blocks_.push_back(CBinFormat::Block{ offset_, static_cast<std::uint32_t>(data.size()),
+        static_cast<std::uint32_t>(block_.size()) });
+    os_.write(data.data(), data.size());
+    offset_ += data.size();
+    block_.clear();
+}
+}
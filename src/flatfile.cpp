@@ -0,0 +1,187 @@
+#include "flatfile.h"
+#include "board.h"
+#include "graph.h"
+#include "piece.h"
+#include "seat.h"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <vector>
+
+using namespace PieceSpace;
+using namespace SeatSpace;
+using namespace BoardSpace;
+namespace InstanceSpace {
+
+static_assert(sizeof(Instance::FlatFile::Header) == 32, "FlatFile::Header must be 32 bytes");
+static_assert(sizeof(Instance::FlatFile::Node) == 20, "FlatFile::Node must be 20 bytes");
+
+Instance::FlatFile::FlatFile(const std::string& fileName)
+    : fileMap_{ fileName }
+{
+    __init();
+}
+
+Instance::FlatFile::FlatFile(const char* data, size_t size)
+    : fileMap_{ data, size }
+{
+    __init();
+}
+
+void Instance::FlatFile::__init()
+{
+    header_ = reinterpret_cast<const Header*>(fileMap_.data());
+    const char* data{ fileMap_.data() };
+    size_t size{ fileMap_.size() };
+    if (size < sizeof(Header) || !std::equal(header_->magic, header_->magic + 4, "CCFB"))
+        throw ParseError("FBIN文件标记不是'CCFB'");
+    if (header_->version != version_)
+        throw ParseError("FBIN文件版本不符");
+    // 以64位计算，避免偏移、个数过大时回绕
+    if (std::uint64_t{ header_->stringOffset } + (std::uint64_t{ header_->stringCount } + 1) * sizeof(std::uint32_t) > size
+        || std::uint64_t{ header_->nodeOffset } + std::uint64_t{ header_->nodeCount } * sizeof(Node) > size
+        || header_->nodeCount == 0 || 2 * std::uint64_t{ header_->infoCount } > header_->stringCount)
+        throw ParseError("FBIN文件头与文件长度不符");
+
+    stringOffsets_ = reinterpret_cast<const std::uint32_t*>(data + header_->stringOffset);
+    strings_ = reinterpret_cast<const char*>(stringOffsets_ + header_->stringCount + 1);
+    // 各字符串须在文件内且以0结尾
+    size_t stringSize{ size - (strings_ - data) };
+    for (std::uint32_t id = 0; id != header_->stringCount; ++id)
+        if (stringOffsets_[id] >= stringOffsets_[id + 1] || stringOffsets_[id + 1] > stringSize
+            || strings_[stringOffsets_[id + 1] - 1] != '\0')
+            throw ParseError("FBIN字符串区有误");
+    nodes_ = reinterpret_cast<const Node*>(data + header_->nodeOffset);
+    // 除根节点外，各着法的起止位置须在棋盘内
+    auto __validRowcol = [](int rowcol) {
+        return rowcol / 10 < SeatManager::RowNum() && rowcol % 10 < SeatManager::ColNum();
+    };
+    for (std::uint32_t index = 1; index != header_->nodeCount; ++index)
+        if (!__validRowcol(nodes_[index].frowcol) || !__validRowcol(nodes_[index].trowcol))
+            throw ParseError("FBIN着法节点有误");
+    if (header_->flags & 0x01) {
+        if (std::uint64_t{ header_->keyOffset } + std::uint64_t{ header_->nodeCount } * sizeof(std::uint64_t) > size)
+            throw ParseError("FBIN文件头与文件长度不符");
+        keys_ = reinterpret_cast<const std::uint64_t*>(data + header_->keyOffset);
+    }
+}
+
+const std::map<std::wstring, std::wstring> Instance::FlatFile::getInfo() const
+{
+    std::map<std::wstring, std::wstring> info{};
+    for (int i = 0; i != static_cast<int>(header_->infoCount); ++i)
+        info[Tools::u82ws(getString(2 * i + 1))] = Tools::u82ws(getString(2 * i + 2));
+    return info;
+}
+
+void Instance::FlatFile::toInstance(Instance& instance) const
+{
+    instance.__reset();
+    instance.info_ = getInfo();
+    instance.board_->reset(instance.__pieceChars());
+    if (nodes_[0].remarkId >= header_->stringCount)
+        throw ParseError("FBIN着法节点有误");
+    instance.rootMove_->setRemark(getRemark(0));
+
+    // 先序排列保证前一节点已建立：是其后续着法则addNext，否则为其变着
+    std::vector<std::shared_ptr<Move>> moves(getNodeCount());
+    moves[0] = instance.rootMove_;
+    for (int index = 1; index != getNodeCount(); ++index) {
+        const Node& node = nodes_[index];
+        if (node.prev >= static_cast<std::uint32_t>(index) || node.remarkId >= header_->stringCount)
+            throw ParseError("FBIN着法节点有误");
+        auto& prevMove = moves[node.prev];
+        moves[index] = (nodes_[node.prev].next == static_cast<std::uint32_t>(index)
+                ? prevMove->addNext()
+                : prevMove->addOther());
+        instance.__setMoveFromRowcol(moves[index], node.frowcol, node.trowcol, getRemark(index));
+    }
+    instance.currentMove_ = instance.rootMove_;
+    instance.__setMoveZhStrAndNums();
+}
+
+void Instance::FlatFile::write(const Instance& instance, std::ostream& os, bool withKey)
+{
+    // 信息的键、值不合并，注解相同则共用一个字符串
+    std::vector<std::string> strings{ "" };
+    for (auto& kv : instance.info_) {
+        strings.push_back(Tools::ws2u8(kv.first));
+        strings.push_back(Tools::ws2u8(kv.second));
+    }
+    std::map<std::string, std::uint32_t> remarkIds{ { "", 0 } };
+    auto __getRemarkId = [&](const std::wstring& remark) {
+        std::string str{ Tools::ws2u8(remark) };
+        auto pos = remarkIds.find(str);
+        if (pos != remarkIds.end())
+            return pos->second;
+        strings.push_back(str);
+        return remarkIds[str] = strings.size() - 1;
+    };
+    auto __getFlags = [](const std::shared_ptr<Move>& move) {
+        return static_cast<std::uint8_t>((move->next() ? 0x80 : 0x00)
+            | (move->other() ? 0x40 : 0x00)
+            | (!move->remark().empty() ? 0x20 : 0x00));
+    };
+
+    std::wstring pieceChars{ instance.__pieceChars() };
+    std::vector<Node> nodes{ Node{ 0, 0, __getFlags(instance.rootMove_), 0,
+        0, 0, 0, __getRemarkId(instance.rootMove_->remark()) } };
+    std::vector<std::uint64_t> keys{ Graph::getKey(pieceChars) };
+    std::function<std::uint32_t(const std::shared_ptr<Move>&, std::uint32_t, std::uint64_t)>
+        __addMove = [&](const std::shared_ptr<Move>& move, std::uint32_t prevIndex, std::uint64_t key) {
+            std::uint32_t index = nodes.size();
+            int frowcol{ move->frowcol() }, trowcol{ move->trowcol() },
+                findex{ SeatManager::getIndex(frowcol) }, tindex{ SeatManager::getIndex(trowcol) };
+            std::uint64_t toKey{ Graph::getMoveKey(key, pieceChars, findex, tindex) };
+            nodes.push_back(Node{ static_cast<std::uint8_t>(frowcol), static_cast<std::uint8_t>(trowcol),
+                __getFlags(move), 0, prevIndex, 0, 0, __getRemarkId(move->remark()) });
+            keys.push_back(toKey);
+            if (move->next()) {
+                wchar_t fch{ pieceChars[findex] }, eatch{ pieceChars[tindex] };
+                pieceChars[tindex] = fch;
+                pieceChars[findex] = PieceManager::nullChar();
+                std::uint32_t next{ __addMove(move->next(), index, toKey) }; // 添加节点后才能取引用
+                nodes[index].next = next;
+                pieceChars[findex] = fch;
+                pieceChars[tindex] = eatch;
+            }
+            if (move->other()) { // 变着与本着同处一个局面
+                std::uint32_t other{ __addMove(move->other(), index, key) };
+                nodes[index].other = other;
+            }
+            return index;
+        };
+    if (instance.rootMove_->next()) {
+        std::uint32_t next{ __addMove(instance.rootMove_->next(), 0, keys[0]) };
+        nodes[0].next = next;
+    }
+
+    // 按布局拼接为一个缓冲区，一次写出
+    auto __align = [](size_t offset) { return (offset + 7) / 8 * 8; };
+    std::vector<std::uint32_t> stringOffsets{ 0 };
+    for (auto& str : strings)
+        stringOffsets.push_back(stringOffsets.back() + str.size() + 1);
+    Header header{ { 'C', 'C', 'F', 'B' }, version_, static_cast<std::uint16_t>(withKey ? 0x01 : 0x00),
+        static_cast<std::uint32_t>(instance.info_.size()), static_cast<std::uint32_t>(strings.size()),
+        static_cast<std::uint32_t>(nodes.size()), sizeof(Header), 0, 0 };
+    header.nodeOffset = __align(header.stringOffset + stringOffsets.size() * sizeof(std::uint32_t)
+        + stringOffsets.back());
+    header.keyOffset = withKey ? __align(header.nodeOffset + nodes.size() * sizeof(Node)) : 0;
+
+    std::string data(withKey ? header.keyOffset + keys.size() * sizeof(std::uint64_t)
+                             : header.nodeOffset + nodes.size() * sizeof(Node),
+        '\0');
+    auto __put = [&](size_t offset, const void* bytes, size_t length) {
+        std::copy_n(static_cast<const char*>(bytes), length, &data[offset]);
+    };
+    __put(0, &header, sizeof(Header));
+    __put(header.stringOffset, stringOffsets.data(), stringOffsets.size() * sizeof(std::uint32_t));
+    size_t stringBegin{ header.stringOffset + stringOffsets.size() * sizeof(std::uint32_t) };
+    for (int id = 0; id != static_cast<int>(strings.size()); ++id)
+        __put(stringBegin + stringOffsets[id], strings[id].data(), strings[id].size());
+    __put(header.nodeOffset, nodes.data(), nodes.size() * sizeof(Node));
+    if (withKey)
+        __put(header.keyOffset, keys.data(), keys.size() * sizeof(std::uint64_t));
+    os.write(data.data(), data.size());
+}
+}
@@ -0,0 +1,170 @@
+#include "graph.h"
+#include "board.h"
+#include "piece.h"
+#include "seat.h"
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+using namespace PieceSpace;
+using namespace SeatSpace;
+using namespace BoardSpace;
+namespace InstanceSpace {
+
+Instance::Graph::Graph(const Instance& instance)
+    : info_{ instance.info_ }
+    , rootPieceChars_{ instance.__pieceChars() }
+    , rootRemark_{ instance.rootMove_->remark() }
+{
+    std::wstring pieceChars{ rootPieceChars_ };
+    std::function<void(const std::shared_ptr<Move>&, int, std::uint64_t)>
+        __addMoves = [&](const std::shared_ptr<Move>& firstMove, int fromIndex, std::uint64_t key) {
+            // firstMove及其变着均从同一局面出发
+            for (auto move = firstMove; move; move = move->other()) {
+                int findex{ SeatManager::getIndex(move->frowcol()) },
+                    tindex{ SeatManager::getIndex(move->trowcol()) };
+                wchar_t fch{ pieceChars[findex] }, eatch{ pieceChars[tindex] };
+                std::uint64_t toKey{ getMoveKey(key, pieceChars, findex, tindex) };
+                int nodeCount = nodes_.size(), toIndex{ __getNodeIndex(toKey) };
+                if (toIndex < nodeCount)
+                    ++transCount_;
+                __addEdge(fromIndex,
+                    Edge{ static_cast<unsigned char>(move->frowcol()),
+                        static_cast<unsigned char>(move->trowcol()), toIndex, 0 },
+                    move->remark());
+
+                if (move->next()) {
+                    pieceChars[tindex] = fch;
+                    pieceChars[findex] = PieceManager::nullChar();
+                    __addMoves(move->next(), toIndex, toKey);
+                    pieceChars[findex] = fch;
+                    pieceChars[tindex] = eatch;
+                }
+            }
+        };
+
+    std::uint64_t rootKey{ getKey(pieceChars) };
+    __getNodeIndex(rootKey);
+    if (instance.rootMove_->next())
+        __addMoves(instance.rootMove_->next(), 0, rootKey);
+}
+
+void Instance::Graph::traverse(const std::function<void(int, const std::wstring&)>& func) const
+{
+    std::vector<bool> visited(nodes_.size(), false);
+    std::wstring pieceChars{ rootPieceChars_ };
+    std::function<void(int)>
+        __visit = [&](int index) {
+            visited[index] = true;
+            func(index, pieceChars);
+            for (auto& edge : nodes_[index].edges)
+                if (!visited[edge.toIndex]) {
+                    int findex{ SeatManager::getIndex(edge.frowcol) },
+                        tindex{ SeatManager::getIndex(edge.trowcol) };
+                    wchar_t eatch{ pieceChars[tindex] };
+                    pieceChars[tindex] = pieceChars[findex];
+                    pieceChars[findex] = PieceManager::nullChar();
+                    __visit(edge.toIndex);
+                    pieceChars[findex] = pieceChars[tindex];
+                    pieceChars[tindex] = eatch;
+                }
+        };
+
+    if (!nodes_.empty())
+        __visit(0);
+}
+
+void Instance::Graph::toInstance(Instance& instance) const
+{
+    instance.__reset();
+    instance.info_ = info_;
+    instance.board_->reset(instance.__pieceChars());
+    instance.rootMove_->setRemark(rootRemark_);
+
+    std::vector<bool> expanded(nodes_.size(), false);
+    std::function<void(int, const std::shared_ptr<Move>&)>
+        __addMoves = [&](int index, const std::shared_ptr<Move>& preMove) {
+            expanded[index] = true;
+            std::shared_ptr<Move> move{};
+            for (auto& edge : nodes_[index].edges) {
+                move = move ? move->addOther() : preMove->addNext();
+                instance.__setMoveFromRowcol(move, edge.frowcol, edge.trowcol,
+                    remarks_[edge.remarkIndex]);
+                if (!expanded[edge.toIndex])
+                    __addMoves(edge.toIndex, move);
+            }
+        };
+
+    if (!nodes_.empty())
+        __addMoves(0, instance.rootMove_);
+    instance.currentMove_ = instance.rootMove_;
+    instance.__setMoveZhStrAndNums();
+}
+
+int Instance::Graph::__getNodeIndex(std::uint64_t key)
+{
+    auto pos = nodeIndexes_.find(key);
+    if (pos != nodeIndexes_.end())
+        return pos->second;
+    int index = nodes_.size();
+    nodes_.push_back(Node{ key, {} });
+    nodeIndexes_[key] = index;
+    return index;
+}
+
+// 同一局面的同一着法只保存一次，注解不同时合并
+void Instance::Graph::__addEdge(int fromIndex, const Edge& edge, const std::wstring& remark)
+{
+    auto& edges = nodes_[fromIndex].edges;
+    auto pos = std::find_if(edges.begin(), edges.end(),
+        [&](const Edge& oldEdge) {
+            return oldEdge.frowcol == edge.frowcol && oldEdge.trowcol == edge.trowcol;
+        });
+    if (pos == edges.end()) {
+        edges.push_back(edge);
+        ++edgeCount_;
+        pos = edges.end() - 1;
+    }
+    if (remark.empty())
+        return;
+    if (pos->remarkIndex == 0) {
+        pos->remarkIndex = remarks_.size();
+        remarks_.push_back(remark);
+    } else if (remarks_[pos->remarkIndex].find(remark) == std::wstring::npos)
+        remarks_[pos->remarkIndex] += L'\n' + remark;
+}
+
+std::uint64_t Instance::Graph::getKey(const std::wstring& pieceChars)
+{
+    std::uint64_t key{ 0 };
+    for (int index = 0; index != static_cast<int>(pieceChars.size()); ++index)
+        key ^= __getSeatKey(pieceChars[index], index);
+    return key;
+}
+
+std::uint64_t Instance::Graph::getMoveKey(std::uint64_t key, const std::wstring& pieceChars, int findex, int tindex)
+{
+    wchar_t fch{ pieceChars[findex] };
+    return key ^ __getSideKey() ^ __getSeatKey(fch, findex)
+        ^ __getSeatKey(fch, tindex) ^ __getSeatKey(pieceChars[tindex], tindex);
+}
+
+std::uint64_t Instance::Graph::__getSeatKey(wchar_t ch, int index)
+{
+    // 棋子字符均为ASCII字符，按字符值与位置序号查表
+    static const std::vector<std::uint64_t> seatKeys = []() {
+        std::mt19937_64 engine{ 20191029 };
+        std::vector<std::uint64_t> keys(128 * 90);
+        for (auto& key : keys)
+            key = engine();
+        return keys;
+    }();
+    return ch == PieceManager::nullChar() ? 0 : seatKeys.at((ch & 0x7F) * 90 + index);
+}
+
+std::uint64_t Instance::Graph::__getSideKey()
+{
+    static const std::uint64_t sideKey{ std::mt19937_64{ 20191101 }() };
+    return sideKey;
+}
+}
@@ -42,6 +42,8 @@ public:
     const std::wstring getZhStr(const std::shared_ptr<SeatSpace::Seat>& fseat,
         const std::shared_ptr<SeatSpace::Seat>& tseat) const;
 
+    static const std::wstring& getTextBlankBoard();
+    static void putTextSeat(std::wstring& textBoard, const SeatSpace::Seat& seat);
     const std::wstring toString() const;
     const std::wstring test();
 
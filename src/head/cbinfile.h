@@ -0,0 +1,89 @@
+#ifndef CBINFILE_H
+#define CBINFILE_H
+// 分块压缩的多局棋谱容器：各局按BIN格式编码，若干局合为一块独立压缩 by-cjp
+
+#include "instance.h"
+#include "tools.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace InstanceSpace {
+
+// 文件布局(小端序)：
+//   文件头"CCCB"、版本号 | 压缩块... | 块索引Block[blockCount] | 棋局索引Game[gameCount]
+//   | 文件尾Footer(定长，位于文件末尾)
+// 压缩块采用LZ77字节序列编码；压缩后不变小的块按原样存储(size == rawSize)
+// 索引紧接压缩块之后，不按4字节对齐，读取时逐项复制；各偏移为uint32，文件不能超过4GB
+// 目录转换(transDir)每个源文件各生成一个只含一局的容器，多局须经CBinWriter逐局写入同一文件
+struct CBinFormat {
+    struct Block {
+        std::uint32_t offset, size, rawSize;
+    };
+    struct Game {
+        std::uint32_t block, offset, size; // 所在块序号、解压后块内的起点、BIN编码长度
+        std::uint32_t movCount, remCount, remLenMax;
+    };
+    struct Footer {
+        std::uint32_t indexOffset, blockCount, gameCount;
+        char magic[4]; // "CCCB"
+    };
+
+    static const std::uint16_t version{ 1 };
+    static const std::uint32_t blockSize{ 64 * 1024 }; // 块内棋局编码达到此长度即压缩写出
+
+    static std::string compress(const std::string& raw);
+    static std::string decompress(const char* data, size_t size, size_t rawSize);
+};
+
+// 只映射文件并读取索引，读取某局时才解压其所在的块(缓存最近一块)
+class Instance::CBinReader {
+public:
+    explicit CBinReader(const std::string& fileName);
+    CBinReader(const char* data, size_t size); // 引用内存中的数据，须在其有效期内使用
+
+    const int getGameCount() const { return footer_.gameCount; }
+    const int getBlockCount() const { return footer_.blockCount; }
+    const CBinFormat::Game getGame(int gameNo) const;
+
+    void toInstance(int gameNo, Instance& instance);
+
+private:
+    void __init();
+    const std::string& __getBlock(int blockNo);
+
+    Tools::FileMap fileMap_;
+    CBinFormat::Footer footer_{};
+    const char* blocks_{}; // 索引的起点，未必对齐
+    const char* games_{};
+    int cacheBlockNo_{ -1 };
+    std::string cacheBlock_{};
+};
+
+// 逐局追加，close()或析构时写出最后一块及索引
+class Instance::CBinWriter {
+public:
+    explicit CBinWriter(std::ostream& os);
+    ~CBinWriter();
+    CBinWriter(const CBinWriter&) = delete;
+    CBinWriter& operator=(const CBinWriter&) = delete;
+
+    void write(const Instance& instance);
+    void close();
+
+    const int getGameCount() const { return games_.size(); }
+
+private:
+    void __writeBlock();
+
+    std::ostream& os_;
+    std::uint32_t offset_{ 0 };
+    std::string block_{};
+    std::vector<CBinFormat::Block> blocks_{};
+    std::vector<CBinFormat::Game> games_{};
+    bool closed_{ false };
+};
+}
+
+#endif
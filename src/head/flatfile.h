@@ -0,0 +1,60 @@
+#ifndef FLATFILE_H
+#define FLATFILE_H
+// 扁平二进制棋谱：定长着法节点数组，映射文件后无需解析即可随机访问 by-cjp
+
+#include "instance.h"
+#include "tools.h"
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace InstanceSpace {
+
+// 文件布局(小端序，各区起点按8字节对齐)：
+//   文件头 | 字符串偏移表uint32[stringCount + 1] | 字符串区(UTF-8，以0结尾)
+//   | 着法节点数组Node[nodeCount] | 局面键值列uint64[nodeCount](可选)
+// 0号字符串为空串，1至2*infoCount号依次为信息的键、值；0号节点为根，节点按先序排列
+class Instance::FlatFile {
+public:
+    struct Header {
+        char magic[4]; // "CCFB"
+        std::uint16_t version, flags; // flags & 0x01：含局面键值列
+        std::uint32_t infoCount, stringCount, nodeCount;
+        std::uint32_t stringOffset, nodeOffset, keyOffset;
+    };
+    struct Node {
+        std::uint8_t frowcol, trowcol, flags, reserved; // flags：0x80有后续着法，0x40有变着，0x20有注解
+        std::uint32_t prev, next, other, remarkId; // 节点序号，0表示没有
+    };
+
+    // 只映射文件并检查文件头，不读取任何着法
+    explicit FlatFile(const std::string& fileName);
+    FlatFile(const char* data, size_t size); // 引用内存中的数据，须在其有效期内使用
+
+    const int getNodeCount() const { return header_->nodeCount; }
+    const Node& getNode(int index) const { return nodes_[index]; }
+    const bool hasKey() const { return keys_ != nullptr; }
+    const std::uint64_t getKey(int index) const { return keys_[index]; } // 着法后的局面键值
+    const char* getString(int id) const { return strings_ + stringOffsets_[id]; }
+    const std::wstring getRemark(int index) const { return Tools::u82ws(getString(nodes_[index].remarkId)); }
+    const std::map<std::wstring, std::wstring> getInfo() const;
+
+    void toInstance(Instance& instance) const;
+    static void write(const Instance& instance, std::ostream& os, bool withKey = true);
+
+private:
+    void __init();
+
+    static const std::uint16_t version_{ 1 };
+
+    Tools::FileMap fileMap_;
+    const Header* header_{};
+    const std::uint32_t* stringOffsets_{};
+    const char* strings_{};
+    const Node* nodes_{};
+    const std::uint64_t* keys_{};
+};
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+// 棋谱局面图：按局面合并变着中的换序着法 by-cjp
+
+#include "instance.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace InstanceSpace {
+
+// 以局面(Zobrist键值)为节点、着法为边的有向图，换序到达的同一局面只保存一次
+// 边按原棋谱中首次出现的顺序排列，注解随边保存，可还原为树形棋谱
+class Instance::Graph {
+public:
+    explicit Graph(const Instance& instance);
+
+    const int getNodeCount() const { return nodes_.size(); }
+    const int getEdgeCount() const { return edgeCount_; }
+    const int getTransCount() const { return transCount_; } // 着法到达已有局面的次数
+
+    // 每个局面只访问一次：局面序号，棋子字符串
+    void traverse(const std::function<void(int, const std::wstring&)>& func) const;
+    // 还原为树形棋谱：换序着法之后的续着只在首次到达该局面时写出
+    void toInstance(Instance& instance) const;
+
+    // 局面键值：全部棋子位置的键值异或；着法后的键值由起止位置增量计算
+    static std::uint64_t getKey(const std::wstring& pieceChars);
+    static std::uint64_t getMoveKey(std::uint64_t key, const std::wstring& pieceChars, int findex, int tindex);
+
+private:
+    struct Edge {
+        unsigned char frowcol, trowcol;
+        int toIndex, remarkIndex;
+    };
+    struct Node {
+        std::uint64_t key;
+        std::vector<Edge> edges;
+    };
+
+    int __getNodeIndex(std::uint64_t key);
+    void __addEdge(int fromIndex, const Edge& edge, const std::wstring& remark);
+
+    static std::uint64_t __getSeatKey(wchar_t ch, int index);
+    static std::uint64_t __getSideKey();
+
+    std::map<std::wstring, std::wstring> info_{};
+    std::wstring rootPieceChars_{}, rootRemark_{};
+    std::vector<Node> nodes_{};
+    std::vector<std::wstring> remarks_{ L"" }; // 0号为空注解
+    std::unordered_map<std::uint64_t, int> nodeIndexes_{};
+    int edgeCount_{ 0 }, transCount_{ 0 };
+};
+}
+
+#endif
@@ -2,8 +2,10 @@
 #define INSTANCE_H
 // 中国象棋棋盘布局类型 by-cjp
 
+#include "tools.h"
 #include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -27,45 +29,86 @@ enum class RecFormat {
     PGN_ZH,
     PGN_CC,
     BIN,
-    JSON
+    JSON,
+    FBIN,
+    FJSON,
+    CBIN
 };
 
 namespace InstanceSpace {
 
+// 棋谱文件内容有误：读取时抛出，不中止程序，批量转换时据此隔离该文件
+class ParseError : public std::runtime_error {
+public:
+    explicit ParseError(const std::string& reason)
+        : std::runtime_error(reason)
+    {
+    }
+};
+
 class Instance {
     class Move;
+    class MoveArena;
 
 public:
+    class Cursor;
+    class Graph;
+    class FlatFile;
+    class CBinReader;
+    class CBinWriter;
+
     Instance();
     Instance(const std::string& infilename);
     void read(const std::string& infilename);
     void write(const std::string& outfilename);
+    // PGN格式(PGN_ICCS、PGN_ZH、PGN_CC)的一局棋谱
+    void read(std::wistream& wis, RecFormat fmt);
+    void write(std::wostream& wos, RecFormat fmt);
+    // 内存中的文件内容，各格式均可
+    void read(const char* data, size_t size, RecFormat fmt);
+    void write(std::ostream& os, RecFormat fmt);
 
     void go();
     void back();
     void backTo(const std::shared_ptr<Move>& move);
     void goOther();
     void goInc(int inc);
+
+    // 在当前着法处编辑，统计数值随之增量更新
+    void addNext(int frowcol, int trowcol, const std::wstring& remark = L"");
+    void addOther(int frowcol, int trowcol, const std::wstring& remark = L"");
+    void cutNext();
+    void cutOther();
+    void setRemark(const std::wstring& remark);
     void changeSide(ChangeType ct);
+    // 交换、对称后中文着法暂不生成(写出时才生成)，需要时可随时补生成
+    void updateZhStr() { __setMoveZhStr(); }
 
     const int getMovCount() const { return movCount_; }
     const int getRemCount() const { return remCount_; }
     const int getRemLenMax() const { return remLenMax_; }
     const int getMaxRow() const { return maxRow_; }
     const int getMaxCol() const { return maxCol_; }
+    const long long getNotationNanos() const { return notationNanos_; } // 最近一次生成中文着法及统计的用时
 
     const std::wstring& remark() const;
+    void toStream(std::wostream& wos); // 逐着输出，内存占用与棋谱大小无关
+    void toStream(std::ostream& os);
     const std::wstring toString();
+    // 规范文本：信息及先序排列的着法(深度、变着序号、ICCS、注解)，各格式读出的同一棋谱应完全相同
+    // fmts非空时，信息只取依次保存为这些格式后仍能保留的部分，以便与经其转换后读回的棋谱比较
+    const std::wstring getCanonical(const std::vector<RecFormat>& fmts = {}) const;
     const std::wstring test();
 
 private:
     void __reset();
-    void __readXQF(std::istream& is);
+    void __readXQF(const char* data, const size_t size);
+    void __writeXQF(std::ostream& os) const;
 
     void __readBIN(std::istream& is);
     void __writeBIN(std::ostream& os) const;
     void __readJSON(std::istream& is);
-    void __writeJSON(std::ostream& os) const;
+    void __writeJSON(std::ostream& os, RecFormat fmt) const;
     void __readInfo_PGN(std::wistream& wis);
     void __writeInfo_PGN(std::wostream& wos) const;
     void __readMove_PGN_ICCSZH(std::wistream& wis, RecFormat fmt);
@@ -78,15 +121,27 @@ private:
     void __setMoveFromStr(const std::shared_ptr<Move>& move,
         const std::wstring& str, RecFormat fmt, const std::wstring& remark = L"") const;
     void __setMoveZhStrAndNums();
+    void __setMoveZhStr();
+    void __setMoveCC_ColNo();
+    void __shiftCC_ColNo(const std::shared_ptr<Move>& move, bool withOther, int inc);
+    static const std::shared_ptr<Move> __lastMove(const std::shared_ptr<Move>& move);
+    void __countMove(const std::shared_ptr<Move>& move, bool isOther, int inc);
+    void __countMoves(const std::shared_ptr<Move>& move, bool isOther, bool withOther, int inc);
+    void __setMaxNums();
     void __setFEN(const std::wstring& pieceChars, PieceColor color);
 
     const std::wstring __pieceChars() const;
     const std::wstring __moveInfo() const;
 
+    // 重新读取时沿用棋盘及着法节点的内存，批量转换中同一对象可连续读取多个文件
+    std::shared_ptr<MoveArena> moveArena_{};
     std::map<std::wstring, std::wstring> info_{};
     std::shared_ptr<BoardSpace::Board> board_{};
     std::shared_ptr<Move> rootMove_{}, currentMove_{ rootMove_ };
     int movCount_{ 0 }, remCount_{ 0 }, remLenMax_{ 0 }, maxRow_{ 0 }, maxCol_{ 0 };
+    std::map<int, int> nextNoNums_{}, remLenNums_{}; // 各着法深度、注解长度的个数
+    bool zhStrValid_{ true }; // 中文着法是否有效（交换、对称后失效）
+    long long notationNanos_{ 0 };
 
     // 着法节点类
     class Move : public std::enable_shared_from_this<Move> {
@@ -119,6 +174,7 @@ private:
             fseat_ = fseat;
             tseat_ = tseat;
         }
+        void setArena(const std::shared_ptr<MoveArena>& arena) { arena_ = arena; }
         void setZhStr(const std::wstring& zhStr) { zhStr_ = zhStr; }
         void setRemark(const std::wstring& remark) { remark_ = remark; }
         const std::wstring toString() const;
@@ -137,18 +193,65 @@ private:
         std::shared_ptr<PieceSpace::Piece> eatPie_{};
         std::shared_ptr<Move> next_{}, other_{};
         std::weak_ptr<Move> prev_{};
+        std::shared_ptr<MoveArena> arena_{}; // 后续着法、变着在同一内存池中分配
 
         int nextNo_{ 0 }, otherNo_{ 0 }, CC_ColNo_{ 0 }; // 图中列位置（需在Instance::setMoves确定）
     };
 };
 
+// 只读游标：自带棋盘状态，不改动棋谱，多个游标可在不同线程中同时遍历同一棋谱
+// 游标存在期间，棋谱不应再被修改
+class Instance::Cursor {
+public:
+    // 可修改的棋谱：先补生成中文着法再建立游标
+    explicit Cursor(const std::shared_ptr<Instance>& instance);
+    // 只读的棋谱：须已生成中文着法(见updateZhStr)，否则抛出std::logic_error
+    explicit Cursor(const std::shared_ptr<const Instance>& instance);
+
+    bool go();
+    bool back();
+    bool goOther();
+    void goInc(int inc);
+    void backToRoot();
+
+    const bool isRoot() const { return path_.empty(); }
+    const int frowcol() const;
+    const int trowcol() const;
+    const std::wstring iccs() const;
+    const std::wstring zh() const;
+    const std::wstring& remark() const;
+    const std::wstring& getPieceChars() const { return pieceChars_; }
+
+private:
+    static const std::shared_ptr<const Instance> __updated(const std::shared_ptr<Instance>& instance);
+    const std::shared_ptr<Move>& __move() const;
+    void __done(const std::shared_ptr<Move>& move);
+    void __undo();
+
+    const std::shared_ptr<const Instance> instance_;
+    std::vector<std::pair<std::shared_ptr<Move>, wchar_t>> path_{}; // 已走着法及所吃棋子
+    std::wstring pieceChars_{};
+};
+
 const std::wstring getWString(std::wistream& wis);
 const std::wstring pieCharsToFEN(const std::wstring& pieceChars); // 便利函数，下同
 const std::wstring FENTopieChars(const std::wstring& fen);
 const std::string getExtName(const RecFormat fmt);
 RecFormat getRecFormat(const std::string& ext);
-void transDir(const std::string& dirfrom, const RecFormat fmt);
-void testTransDir(int fd, int td, int ff, int ft, int tf, int tt);
+// threadCount为转换线程数，<=0时取CPU核数；出错的文件记入目标目录的隔离清单，
+// continueOnError为false时遇到第一个出错的文件即中止
+// statsFile非空时，另将各阶段、各格式的用时统计以JSON格式写入该文件
+// 非棋谱文件不经流水线，按copyMode直接复制到目标目录；返回出错隔离的文件数
+// 每个源文件只生成一个目标文件，含多局的PGN文件按出错隔离(可用PGNReader逐局读取)
+int transDir(const std::string& dirfrom, const RecFormat fmt, int threadCount = 0, bool continueOnError = true,
+    const std::string& statsFile = "", Tools::CopyMode copyMode = Tools::CopyMode::KERNEL);
+// dirfroms为不带格式扩展名的源目录，如"示例文件"即依次转换"示例文件.xqf"等目录；fd、td等为各循环的初值、终值
+void testTransDir(const std::vector<std::string>& dirfroms, int fd, int td, int ff, int ft, int tf, int tt,
+    int threadCount = 0, bool continueOnError = true);
+// 校验目录下的每个棋谱：经任意两种格式先后写出、读回，规范文本均应与原棋谱相同
+// 输出各格式对的不符文件数；每个不符文件只报告第一处分歧，reportFile非空时写入该文件
+// 比较时只计各格式能保存的信息(见getCanonical)；返回不符及读取出错的文件数
+int verifyDir(const std::string& dirfrom, int threadCount = 0, const std::string& reportFile = "");
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef PGNFILE_H
+#define PGNFILE_H
+// 多局PGN棋谱文件：逐局读取、按局序号定位及追加写入 by-cjp
+
+#include "instance.h"
+#include <fstream>
+#include <ios>
+#include <string>
+#include <vector>
+
+namespace InstanceSpace {
+
+// 文件由若干局PGN棋谱(PGN_ICCS、PGN_ZH或PGN_CC)前后连接而成，格式由扩展名确定，不是PGN格式时构造即抛出ParseError
+// 每局以信息行'['开始，着法区(注解之外)再次出现信息行即为下一局的开始
+class PGNReader {
+public:
+    explicit PGNReader(const std::string& fileName);
+    // 从已打开的流中逐局读取(如标准输入)，格式由fmt指定；流不可定位时不能使用seek()、getIndex()
+    PGNReader(std::wistream& wis, RecFormat fmt);
+
+    // 读取下一局至instance，已无棋谱时返回false；每次只缓存一局的文本
+    bool next(Instance& instance);
+    // 略过下一局(不解析)，已无棋谱时返回false
+    bool skip();
+    // 定位至第gameNo局(从0开始)，之后next()读取该局
+    bool seek(int gameNo);
+
+    const int getGameNo() const { return gameNo_; }
+    // 各局起点的文件位置，首次调用时扫描一遍全文件建立
+    const std::vector<std::streampos>& getIndex();
+
+private:
+    enum class LineType {
+        BLANK,
+        INFO,
+        OTHER
+    };
+    LineType __getLineType(const std::wstring& line) const;
+    bool __getLine(std::wstring& line);
+    // 读取一局的全部行至text(可为空)，遇到下一局的信息行时暂存该行
+    bool __readGame(std::wstring* text);
+
+    RecFormat fmt_;
+    std::wifstream file_{};
+    std::wistream& wis_;
+    std::wstring pendingLine_{};
+    std::streampos pendingPos_{}, linePos_{}, gamePos_{};
+    bool hasPending_{ false }, recordPos_{ false };
+    int gameNo_{ 0 };
+    std::vector<std::streampos> index_{};
+    bool hasIndex_{ false };
+};
+
+class PGNWriter {
+public:
+    // append为true时追加至已有文件末尾
+    explicit PGNWriter(const std::string& fileName, bool append = false);
+
+    void write(Instance& instance);
+    const int getGameCount() const { return gameCount_; }
+
+private:
+    RecFormat fmt_;
+    std::wofstream wos_;
+    int gameCount_{ 0 };
+};
+}
+
+#endif
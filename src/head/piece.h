@@ -3,6 +3,7 @@
 
 #include <map>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace SeatSpace {
@@ -27,6 +28,9 @@ public:
     const wchar_t ch() const { return ch_; }
     const wchar_t name() const { return name_; }
     const PieceColor color() const { return color_; }
+    // 最近一次放置的位置，该位置上仍是本棋子时即为活棋子
+    const int rowcol() const { return rowcol_; }
+    void setRowcol(const int rowcol) { rowcol_ = rowcol; }
     const std::wstring toString() const;
 
     const std::vector<std::shared_ptr<SeatSpace::Seat>>
@@ -43,6 +47,7 @@ private:
     __moveSeats(const BoardSpace::Board& board, SeatSpace::Seat& fseat) const = 0;
     const wchar_t ch_, name_;
     const PieceColor color_;
+    int rowcol_{ -1 };
 };
 
 class King : public Piece {
@@ -124,15 +129,39 @@ public:
     getOtherPiece(const std::shared_ptr<Piece>& piece) const;
     const std::vector<std::shared_ptr<Piece>>
     getBoardPieces(const std::wstring& pieceChars) const;
+    // 某方某种棋子(最多5个)，不论是否在棋盘上
+    const std::vector<std::shared_ptr<Piece>>&
+    getKindPieces(const PieceColor color, const wchar_t name) const;
 
     const std::wstring toString() const;
 
 private:
+    static const std::unordered_map<const Piece*, std::shared_ptr<Piece>>
+    __getOtherPieces(const std::vector<std::shared_ptr<Piece>>& allPieces);
+    static const std::map<std::pair<PieceColor, wchar_t>, std::vector<std::shared_ptr<Piece>>>
+    __getKindPieces(const std::vector<std::shared_ptr<Piece>>& allPieces);
+
     const std::vector<std::shared_ptr<Piece>> allPieces_;
+    const std::unordered_map<const Piece*, std::shared_ptr<Piece>> otherPieces_;
+    const std::map<std::pair<PieceColor, wchar_t>, std::vector<std::shared_ptr<Piece>>> kindPieces_;
 };
 
 class PieceManager {
 public:
+    // 中文着法字符的类别：前中后、棋子名、退平进、数字
+    enum class ZhCharType {
+        NONE,
+        PRE,
+        NAME,
+        MOV,
+        NUM
+    };
+    struct ZhChar {
+        ZhCharType type;
+        int index; // 在所属字符串中的序号
+        PieceColor color; // 数字所属的一方
+    };
+
     static const std::vector<std::shared_ptr<Piece>> createPieces();
 
     static const std::wstring getZhChars()
@@ -148,6 +177,10 @@ public:
 
     static const std::wstring getFENStr() { return FENStr_; }
 
+    // 查表取得字符的类别和序号，不在表中的字符类别为NONE
+    static const ZhChar& getZhChar(const wchar_t ch);
+    static const bool isZhChar(const wchar_t ch) { return getZhChar(ch).type != ZhCharType::NONE; }
+
     static const int getRowFromICCSChar(const wchar_t ch) { return ch - '0'; } // 0:48
     static const int getColFromICCSChar(const wchar_t ch) { return ICCSChars_.find(ch); }
     static const wchar_t getColICCSChar(const int col) { return ICCSChars_.at(col); }
@@ -163,7 +196,7 @@ public:
 
     static const int getMovNum(const bool isBottom, const wchar_t movChar)
     {
-        return (static_cast<int>(movChars_.find(movChar)) - 1) * (isBottom ? 1 : -1);
+        return (__getIndex(movChar, ZhCharType::MOV) - 1) * (isBottom ? 1 : -1);
     }
 
     static const wchar_t getMovChar(const bool isSameRow, bool isBottom, bool isLowToUp)
@@ -173,7 +206,8 @@ public:
 
     static const int getNum(const PieceColor color, const wchar_t numChar)
     {
-        return static_cast<int>(numChars_.at(color).find(numChar)) + 1;
+        const ZhChar& zhChar{ getZhChar(numChar) };
+        return (zhChar.type == ZhCharType::NUM && zhChar.color == color ? zhChar.index : -1) + 1;
     }
 
     static const wchar_t getNumChar(const PieceColor color, const int num)
@@ -184,37 +218,46 @@ public:
     static const int getCol(bool isBottom, const int num);
     static const wchar_t getColChar(const PieceColor color, bool isBottom, const int col);
 
+    // 按棋子名在nameChars_中的序号区间判断
     static const bool isKing(const wchar_t name)
     {
-        return nameChars_.substr(0, 2).find(name) != std::wstring::npos;
+        int index{ __getIndex(name, ZhCharType::NAME) };
+        return index >= 0 && index < 2;
     }
 
     static const bool isAdvBish(const wchar_t name)
     {
-        return nameChars_.substr(2, 4).find(name) != std::wstring::npos;
+        int index{ __getIndex(name, ZhCharType::NAME) };
+        return index >= 2 && index < 6;
     }
 
     static const bool isStronge(const wchar_t name)
     {
-        return nameChars_.substr(6, 5).find(name) != std::wstring::npos;
+        return __getIndex(name, ZhCharType::NAME) >= 6;
     }
 
     static const bool isLineMove(const wchar_t name)
     {
-        return isKing(name) || nameChars_.substr(7, 4).find(name) != std::wstring::npos;
+        return isKing(name) || __getIndex(name, ZhCharType::NAME) >= 7;
     }
 
     static const bool isPawn(const wchar_t name)
     {
-        return nameChars_.substr(nameChars_.size() - 2, 2).find(name) != std::wstring::npos;
+        return __getIndex(name, ZhCharType::NAME) >= static_cast<int>(nameChars_.size()) - 2;
     }
 
     static const bool isPiece(const wchar_t name)
     {
-        return nameChars_.find(name) != std::wstring::npos;
+        return __getIndex(name, ZhCharType::NAME) >= 0;
     };
 
 private:
+    static const int __getIndex(const wchar_t ch, const ZhCharType type)
+    {
+        const ZhChar& zhChar{ getZhChar(ch) };
+        return zhChar.type == type ? zhChar.index : -1;
+    }
+
     static const std::wstring __getPreChars(const int length)
     {
         return (length == 2 ? (std::wstring{ preChars_ }).erase(1, 1) //L"前后"
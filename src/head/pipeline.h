@@ -0,0 +1,153 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+// 有界无锁队列：连接批量转换流水线的各级；分阶段、分格式的用时统计 by-cjp
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Tools {
+
+// 多生产者、多消费者的环形队列：各单元以序号标记可写、可读，按序号竞争认领
+// 队列满时push等待，使上一级随下一级的速度放慢；生产者全部结束后close()
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : cells_(__roundUp(capacity))
+        , mask_{ cells_.size() - 1 }
+    {
+        for (size_t index = 0; index != cells_.size(); ++index)
+            cells_[index].sequence.store(index, std::memory_order_relaxed);
+    }
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    void push(T&& value)
+    {
+        for (int spins = 0; !__tryPush(value);)
+            __wait(spins);
+    }
+    // 队列为空且已关闭时返回false
+    bool pop(T& value)
+    {
+        for (int spins = 0; !__tryPop(value);) {
+            if (closed_.load(std::memory_order_acquire))
+                return __tryPop(value);
+            __wait(spins);
+        }
+        return true;
+    }
+    void close() { closed_.store(true, std::memory_order_release); }
+    // 不等待：满时放弃写入、空时放弃读取，返回false；可用作对象池
+    bool tryPush(T&& value) { return __tryPush(value); }
+    bool tryPop(T& value) { return __tryPop(value); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    bool __tryPush(T& value)
+    {
+        size_t pos{ enqueuePos_.load(std::memory_order_relaxed) };
+        Cell* cell{};
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            std::intptr_t diff = static_cast<std::intptr_t>(cell->sequence.load(std::memory_order_acquire))
+                - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0)
+                return false; // 已满
+            else
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    bool __tryPop(T& value)
+    {
+        size_t pos{ dequeuePos_.load(std::memory_order_relaxed) };
+        Cell* cell{};
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            std::intptr_t diff = static_cast<std::intptr_t>(cell->sequence.load(std::memory_order_acquire))
+                - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0)
+                return false; // 已空
+            else
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+        }
+        value = std::move(cell->value);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 先让出时间片，久等不到再短暂休眠，避免空转占用CPU
+    static void __wait(int& spins)
+    {
+        if (++spins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    static size_t __roundUp(size_t capacity)
+    {
+        size_t size{ 2 };
+        while (size < capacity)
+            size <<= 1;
+        return size;
+    }
+
+    std::vector<Cell> cells_;
+    const size_t mask_;
+    alignas(64) std::atomic<size_t> enqueuePos_{ 0 };
+    alignas(64) std::atomic<size_t> dequeuePos_{ 0 };
+    std::atomic<bool> closed_{ false };
+};
+
+// 按阶段、格式记录每个文件的字节数与用时，输出吞吐量及用时分位数
+// 非线程安全：每个线程各用一个，结束后merge到一起
+class PhaseStats {
+public:
+    struct Phase {
+        std::string name, key; // 显示名称(两个汉字)，JSON键名
+    };
+
+    explicit PhaseStats(const std::vector<Phase>& phases);
+
+    void add(int phase, const std::string& format, long long bytes, long long nanos);
+    void merge(const PhaseStats& other);
+
+    // 吞吐量按各文件用时之和计算，即单线程的处理速度；wallNanos为整体耗时
+    void print(std::ostream& os, long long wallNanos) const;
+    void writeJSON(std::ostream& os, long long wallNanos) const;
+
+private:
+    struct Record {
+        long long bytes{ 0 }, nanos{ 0 };
+        std::vector<long long> samples{}; // 每个文件的用时
+    };
+
+    static long long __percentile(const std::vector<long long>& sorted, int percent);
+
+    std::vector<Phase> phases_;
+    std::vector<std::map<std::string, Record>> records_; // 阶段 -> 格式 -> 记录
+};
+}
+
+#endif
@@ -34,7 +34,7 @@ public:
     const std::shared_ptr<PieceSpace::Piece>& piece() const { return piece_; }
 
     const std::vector<std::shared_ptr<Seat>> getMoveSeats(const BoardSpace::Board& board);
-    void put(const std::shared_ptr<PieceSpace::Piece>& piece = nullptr) { piece_ = piece; }
+    void put(const std::shared_ptr<PieceSpace::Piece>& piece = nullptr);
     const std::shared_ptr<PieceSpace::Piece>
     movTo(Seat& tseat, const std::shared_ptr<PieceSpace::Piece>& fillPiece = nullptr);
 
@@ -47,7 +47,7 @@ private:
 
 class Seats {
 public:
-    Seats();
+    explicit Seats(const std::shared_ptr<PieceSpace::Pieces>& pieces);
 
     const std::shared_ptr<Seat>& getSeat(const int row, const int col) const;
     const std::shared_ptr<Seat>& getSeat(const int rowcol) const;
@@ -72,12 +72,14 @@ public:
 
 private:
     const std::vector<std::shared_ptr<Seat>> allSeats_;
+    const std::shared_ptr<PieceSpace::Pieces> pieces_; // 按棋子种类查找活棋子，免于扫描全部位置
 };
 
 class SeatManager {
 public:
     static const std::vector<std::shared_ptr<Seat>> creatSeats();
 
+    static const int RowNum() { return RowNum_; };
     static const int ColNum() { return ColNum_; };
     static const bool isBottom(const int row) { return row < RowLowUpIndex_; };
     static const int getIndex(const int row, const int col) { return row * ColNum_ + col; }
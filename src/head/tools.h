@@ -4,6 +4,10 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <functional>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
 
 
 namespace Tools {
@@ -12,12 +16,79 @@ std::string trim(std::string& str);
 std::wstring wtrim(std::wstring& str);
 std::wstring s2ws(const std::string& s);
 std::string ws2s(const std::wstring& ws);
+std::string ws2u8(const std::wstring& ws);
+std::wstring u82ws(const std::string& s);
+// 按全局locale编码转换，与宽字符文件流读写的结果相同
+std::wstring decode(const std::string& s);
+std::string encode(const std::wstring& ws);
 
 const std::string getExt(const std::string& filename);
 std::wstring readTxt(const std::string& fileName);
 void writeTxt(const std::string& fileName, const std::wstring& ws);
 void getFiles(const std::string& path, std::vector<std::string>& files);
 int copyFile(const char* sourceFile, const char* newFile);
+// 复制方式：STREAM经用户空间缓冲；KERNEL由内核复制(copy_file_range/sendfile，Windows为CopyFile)
+// REFLINK共享数据块、写时复制；HARDLINK建立硬链接，与源文件为同一文件
+// 当前方式不可用(如跨文件系统、平台不支持)时依次退回下一种：HARDLINK->REFLINK->KERNEL->STREAM
+enum class CopyMode {
+    STREAM,
+    KERNEL,
+    REFLINK,
+    HARDLINK
+};
+bool copyFile(const std::string& sourceFile, const std::string& newFile, CopyMode mode);
+// 以newFile替换已有文件，同一文件系统内为原子操作：先写临时文件再改名，中途中止不会留下半个文件
+bool renameFile(const std::string& oldFile, const std::string& newFile);
+
+// 目录的直接下级文件名、子目录名(不含"."、".."及路径)，Windows与POSIX通用
+void getEntries(const std::string& path, std::vector<std::string>& files, std::vector<std::string>& dirs);
+// 目录已存在也返回true
+bool makeDir(const std::string& path);
+// 文件不存在时返回false
+bool getFileStat(const std::string& fileName, long long& size, long long& mtime);
+// FNV-1a 64位散列
+std::uint64_t getHash(const char* data, size_t size);
+// threadCount个线程依次领取序号[0, count)执行func(index, workerNo)，threadCount<=0时取CPU核数
+void parallelFor(int count, int threadCount, const std::function<void(int, int)>& func);
+
+// 追加写入的日志文件：每行先写入缓冲，满syncCount行或距上次落盘超过syncMillis毫秒时fsync
+// 上次中止时留下的不完整末行另起一行，读取时应忽略不完整的行
+class Journal {
+public:
+    explicit Journal(const std::string& fileName, int syncCount = 64, int syncMillis = 1000);
+    ~Journal() { close(); }
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    void append(const std::string& line);
+    void sync();
+    void close();
+
+private:
+    std::FILE* file_;
+    const int syncCount_, syncMillis_;
+    int pending_{ 0 };
+    std::chrono::steady_clock::time_point lastSync_{ std::chrono::steady_clock::now() };
+};
+
+// 只读映射整个文件，映射失败时整体读入内存
+class FileMap {
+public:
+    explicit FileMap(const std::string& fileName);
+    FileMap(const char* data, size_t size); // 引用已在内存中的数据，不复制
+    ~FileMap();
+    FileMap(const FileMap&) = delete;
+    FileMap& operator=(const FileMap&) = delete;
+
+    const char* data() const { return data_; }
+    const size_t size() const { return size_; }
+
+private:
+    const char* data_{ nullptr };
+    size_t size_{ 0 };
+    void* mapping_{ nullptr };
+    std::string buffer_{};
+};
 
 // 测试函数
 const std::wstring test();
@@ -1,20 +1,36 @@
 #include "instance.h"
-#include "../json/json.h"
 #include "board.h"
+#include "cbinfile.h"
+#include "flatfile.h"
+#include "graph.h"
+#include "pgnfile.h"
+#include "pipeline.h"
 #include "piece.h"
 #include "seat.h"
 #include "tools.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cwctype>
 #include <cmath>
-#include <direct.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <regex>
+#include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace PieceSpace;
@@ -22,6 +38,104 @@ using namespace SeatSpace;
 using namespace BoardSpace;
 namespace InstanceSpace {
 
+// 着法节点的内存池：整块分配、顺序切分，释放的节点挂入空闲链表供再次分配
+// 重置棋谱时如旧节点已全部释放，则从第一块起顺序复用，已分配的块不归还
+// 每个节点(经分配器)持有内存池，节点比棋谱对象存活更久时内存池随之保留
+class Instance::MoveArena : public std::enable_shared_from_this<MoveArena> {
+public:
+    std::shared_ptr<Move> create()
+    {
+        auto arena = shared_from_this();
+        auto move = std::allocate_shared<Move>(Allocator<Move>{ arena });
+        move->setArena(arena);
+        return move;
+    }
+    void rewind()
+    {
+        if (liveCount_ == 0) {
+            blockIndex_ = offset_ = 0;
+            freeList_ = nullptr;
+        }
+    }
+
+private:
+    // 供allocate_shared使用，节点与引用计数在同一次分配中
+    template <typename T>
+    class Allocator {
+    public:
+        typedef T value_type;
+
+        explicit Allocator(const std::shared_ptr<MoveArena>& arena)
+            : arena_{ arena }
+        {
+        }
+        template <typename U>
+        Allocator(const Allocator<U>& other)
+            : arena_{ other.arena_ }
+        {
+        }
+
+        T* allocate(size_t count) { return static_cast<T*>(arena_->__allocate(count * sizeof(T))); }
+        void deallocate(T* ptr, size_t count) { arena_->__deallocate(ptr, count * sizeof(T)); }
+
+        template <typename U>
+        bool operator==(const Allocator<U>& other) const { return arena_ == other.arena_; }
+        template <typename U>
+        bool operator!=(const Allocator<U>& other) const { return arena_ != other.arena_; }
+
+    private:
+        template <typename U>
+        friend class Allocator;
+
+        std::shared_ptr<MoveArena> arena_;
+    };
+
+    static size_t __roundUp(size_t size)
+    {
+        const size_t align{ alignof(std::max_align_t) };
+        return (size + align - 1) / align * align;
+    }
+
+    // 节点大小都相同，空闲链表只收该大小的内存，链接指针存放在空闲内存自身
+    void* __allocate(size_t size)
+    {
+        size = __roundUp(size);
+        ++liveCount_;
+        if (freeList_ && size == nodeSize_) {
+            void* ptr{ freeList_ };
+            freeList_ = *static_cast<void**>(ptr);
+            return ptr;
+        }
+        if (offset_ + size > blockSize_) {
+            ++blockIndex_;
+            offset_ = 0;
+        }
+        if (blockIndex_ == blocks_.size())
+            blocks_.emplace_back(new char[std::max(blockSize_, size)]);
+        void* ptr{ blocks_[blockIndex_].get() + offset_ };
+        offset_ += size;
+        if (nodeSize_ == 0)
+            nodeSize_ = size;
+        return ptr;
+    }
+    void __deallocate(void* ptr, size_t size)
+    {
+        --liveCount_;
+        if (__roundUp(size) != nodeSize_)
+            return;
+        *static_cast<void**>(ptr) = freeList_;
+        freeList_ = ptr;
+    }
+
+    static const size_t blockSize_{ 64 * 1024 };
+
+    std::vector<std::unique_ptr<char[]>> blocks_{};
+    size_t blockIndex_{ 0 }, offset_{ 0 }, liveCount_{ 0 }, nodeSize_{ 0 };
+    void* freeList_{ nullptr };
+};
+
+const size_t Instance::MoveArena::blockSize_;
+
 // Instance
 Instance::Instance()
     : info_{ { L"FEN", PieceManager::getFENStr() } }
@@ -72,6 +186,101 @@ void Instance::goInc(int inc)
         fbward(this);
 }
 
+void Instance::addNext(int frowcol, int trowcol, const std::wstring& remark)
+{
+    std::shared_ptr<Move> move{ currentMove_->next() };
+    bool isOther{ move != nullptr };
+    // 视图列数：后续着法与本着同列；变着新占一列，列于其前着法之后，先序在其后的着法右移一列
+    int colNo{ currentMove_->CC_ColNo() };
+    if (isOther) { // 已有后续着法，则作为其最后一个变着
+        while (move->other())
+            move = move->other();
+        colNo = __lastMove(move)->CC_ColNo() + 1;
+        move = move->addOther();
+    } else
+        move = currentMove_->addNext();
+    __setMoveFromRowcol(move, frowcol, trowcol, remark);
+    if (zhStrValid_)
+        move->setZhStr(board_->getZhStr(move->fseat(), move->tseat()));
+    move->setCC_ColNo(colNo);
+    if (isOther)
+        __shiftCC_ColNo(move, true, 1);
+    __countMove(move, isOther, 1);
+    __setMaxNums();
+}
+
+void Instance::addOther(int frowcol, int trowcol, const std::wstring& remark)
+{
+    if (currentMove_ == rootMove_)
+        return;
+    std::shared_ptr<Move> move{ currentMove_ };
+    while (move->other())
+        move = move->other();
+    int colNo{ __lastMove(move)->CC_ColNo() + 1 };
+    move = move->addOther();
+    __setMoveFromRowcol(move, frowcol, trowcol, remark);
+    if (zhStrValid_) { // 变着与本着同处一个局面
+        currentMove_->undo();
+        move->setZhStr(board_->getZhStr(move->fseat(), move->tseat()));
+        currentMove_->done();
+    }
+    move->setCC_ColNo(colNo);
+    __shiftCC_ColNo(move, true, 1);
+    __countMove(move, true, 1);
+    __setMaxNums();
+}
+
+void Instance::cutNext()
+{
+    std::shared_ptr<Move> move{ currentMove_->next() };
+    if (!move)
+        return;
+    // 删去的着法(含全部变着)共占若干列，先序在其后的着法左移同样列数
+    std::shared_ptr<Move> lastOther{ move };
+    while (lastOther->other())
+        lastOther = lastOther->other();
+    __shiftCC_ColNo(move, false, move->CC_ColNo() - __lastMove(lastOther)->CC_ColNo());
+    __countMoves(move, false, true, -1);
+    currentMove_->cutNext();
+    __setMaxNums();
+}
+
+void Instance::cutOther()
+{
+    std::shared_ptr<Move> move{ currentMove_->other() };
+    if (currentMove_ == rootMove_ || !move)
+        return;
+    // 删去的变着及其后续着法共占若干列(变着自身占一列)
+    __shiftCC_ColNo(move, true, move->CC_ColNo() - __lastMove(move)->CC_ColNo() - 1);
+    __countMoves(move, true, false, -1);
+    currentMove_->cutOther();
+    if (currentMove_->other()) { // 其后的变着前移一列
+        currentMove_->other()->setPrev(currentMove_);
+        std::function<void(const std::shared_ptr<Move>&)>
+            __decOtherNo = [&](const std::shared_ptr<Move>& move) {
+                move->setOtherNo(move->otherNo() - 1);
+                if (move->next())
+                    __decOtherNo(move->next());
+                if (move->other())
+                    __decOtherNo(move->other());
+            };
+        __decOtherNo(currentMove_->other());
+    }
+    __setMaxNums();
+}
+
+void Instance::setRemark(const std::wstring& remark)
+{
+    if (currentMove_ == rootMove_) {
+        rootMove_->setRemark(remark);
+        return;
+    }
+    __countMove(currentMove_, false, -1);
+    currentMove_->setRemark(remark);
+    __countMove(currentMove_, false, 1);
+    __setMaxNums();
+}
+
 void Instance::changeSide(ChangeType ct)
 {
     std::vector<std::shared_ptr<Move>> prevMoves{};
@@ -83,59 +292,98 @@ void Instance::changeSide(ChangeType ct)
         auto changeRowcol = (ct == ChangeType::ROTATE
                 ? &SeatManager::getRotate
                 : &SeatManager::getSymmetry);
-        //auto changeRowcol = std::mem_fn(ct == ChangeType::ROTATE ? &SeatManager::getRotate : &SeatManager::getSymmetry);
-        std::function<void(const std::shared_ptr<Move>&)>
-            __resetMove = [&](const std::shared_ptr<Move>& move) {
-                __setMoveFromRowcol(move, changeRowcol(move->fseat()->rowcol()),
-                    changeRowcol(move->tseat()->rowcol()), move->remark());
-                if (move->next())
-                    __resetMove(move->next());
-                if (move->other())
-                    __resetMove(move->other());
-            };
+        // 着法只需变换坐标，一次线性遍历完成，无需按棋盘重新解析
+        std::vector<std::shared_ptr<Move>> moves{};
         if (rootMove_->next())
-            __resetMove(rootMove_->next());
+            moves.push_back(rootMove_->next());
+        while (!moves.empty()) {
+            auto move = moves.back();
+            moves.pop_back();
+            move->setFTSeat(board_->getSeat(changeRowcol(move->frowcol())),
+                board_->getSeat(changeRowcol(move->trowcol())));
+            if (move->other())
+                moves.push_back(move->other());
+            if (move->next())
+                moves.push_back(move->next());
+        }
     }
     __setFEN(board_->getPieceChars(),
-        (rootMove_->next()->fseat()
+        (rootMove_->next() && rootMove_->next()->fseat()
                 ? rootMove_->next()->fseat()->piece()->color()
                 : PieceColor::RED));
+    // 旋转不改变中文着法；交换、对称后，待需要时再重新生成
     if (ct != ChangeType::ROTATE)
-        __setMoveZhStrAndNums();
+        zhStrValid_ = false;
     for (auto& move : prevMoves)
         move->done();
 }
 
 void Instance::read(const std::string& infilename)
 {
-    __reset();
     RecFormat fmt = getRecFormat(Tools::getExt(infilename));
-    std::ifstream is{};
-    std::wifstream wis{};
-    if (fmt == RecFormat::XQF || fmt == RecFormat::BIN || fmt == RecFormat::JSON)
-        is = std::ifstream(infilename, std::ios_base::binary);
-    else
-        wis = std::wifstream(infilename);
+    if (fmt == RecFormat::PGN_ICCS || fmt == RecFormat::PGN_ZH || fmt == RecFormat::PGN_CC) {
+        std::wifstream wis(infilename);
+        read(wis, fmt);
+        return;
+    }
+    Tools::FileMap fileMap(infilename);
+    read(fileMap.data(), fileMap.size(), fmt);
+}
+
+void Instance::read(const char* data, size_t size, RecFormat fmt)
+{
+    if (fmt == RecFormat::PGN_ICCS || fmt == RecFormat::PGN_ZH || fmt == RecFormat::PGN_CC) {
+        // 同文本方式的文件流：按locale解码，Windows下将"\r\n"换为"\n"
+        std::wstring text{ Tools::decode(std::string(data, size)) };
+#ifdef _WIN32
+        auto pos = text.begin();
+        for (auto iter = text.begin(); iter != text.end(); ++iter)
+            if (!(*iter == L'\r' && iter + 1 != text.end() && *(iter + 1) == L'\n'))
+                *pos++ = *iter;
+        text.erase(pos, text.end());
+#endif
+        std::wistringstream wis{ text };
+        read(wis, fmt);
+        return;
+    }
+    __reset();
+    std::istringstream is{};
+    if (fmt == RecFormat::BIN || fmt == RecFormat::JSON || fmt == RecFormat::FJSON)
+        is.str(std::string(data, size));
     switch (fmt) {
     case RecFormat::XQF:
-        __readXQF(is);
+        __readXQF(data, size);
         break;
     case RecFormat::BIN:
         __readBIN(is);
         break;
     case RecFormat::JSON:
+    case RecFormat::FJSON: // 按moves的值是对象还是数组区分
         __readJSON(is);
         break;
-    case RecFormat::PGN_ICCS:
-        __readInfo_PGN(wis);
-        __readMove_PGN_ICCSZH(wis, RecFormat::PGN_ICCS);
+    case RecFormat::FBIN: // 已生成中文着法及统计数据
+        FlatFile(data, size).toInstance(*this);
+        return;
+    case RecFormat::CBIN: // 多局时读取第一局
+        CBinReader(data, size).toInstance(0, *this);
+        return;
+    default:
         break;
+    }
+    currentMove_ = rootMove_;
+    __setMoveZhStrAndNums();
+}
+
+void Instance::read(std::wistream& wis, RecFormat fmt)
+{
+    __reset();
+    __readInfo_PGN(wis);
+    switch (fmt) {
+    case RecFormat::PGN_ICCS:
     case RecFormat::PGN_ZH:
-        __readInfo_PGN(wis);
-        __readMove_PGN_ICCSZH(wis, RecFormat::PGN_ZH);
+        __readMove_PGN_ICCSZH(wis, fmt);
         break;
     case RecFormat::PGN_CC:
-        __readInfo_PGN(wis);
         __readMove_PGN_CC(wis);
         break;
     default:
@@ -148,31 +396,56 @@ void Instance::read(const std::string& infilename)
 void Instance::write(const std::string& outfilename)
 {
     RecFormat fmt = getRecFormat(Tools::getExt(outfilename));
-    std::ofstream os{};
-    std::wofstream wos{};
-    if (fmt == RecFormat::XQF || fmt == RecFormat::BIN || fmt == RecFormat::JSON)
-        os = std::ofstream(outfilename, std::ios_base::binary);
-    else
-        wos = std::wofstream(outfilename);
+    if (fmt == RecFormat::PGN_ICCS || fmt == RecFormat::PGN_ZH || fmt == RecFormat::PGN_CC) {
+        std::wofstream wos(outfilename);
+        write(wos, fmt);
+        return;
+    }
+    std::ofstream os(outfilename, std::ios_base::binary);
+    write(os, fmt);
+}
+
+void Instance::write(std::ostream& os, RecFormat fmt)
+{
     switch (fmt) {
     case RecFormat::XQF:
+        __writeXQF(os);
         break;
     case RecFormat::BIN:
         __writeBIN(os);
         break;
     case RecFormat::JSON:
-        __writeJSON(os);
+        __writeJSON(os, RecFormat::JSON);
         break;
-    case RecFormat::PGN_ICCS:
-        __writeInfo_PGN(wos);
-        __writeMove_PGN_ICCSZH(wos, RecFormat::PGN_ICCS);
+    case RecFormat::FJSON:
+        __writeJSON(os, RecFormat::FJSON);
+        break;
+    case RecFormat::FBIN:
+        FlatFile::write(*this, os);
+        break;
+    case RecFormat::CBIN:
+        CBinWriter(os).write(*this);
         break;
+    default: { // PGN格式按locale编码，换行符不转换
+        std::wostringstream wos{};
+        write(wos, fmt);
+        os << Tools::encode(wos.str());
+        break;
+    }
+    }
+}
+
+void Instance::write(std::wostream& wos, RecFormat fmt)
+{
+    if (fmt == RecFormat::PGN_ZH || fmt == RecFormat::PGN_CC)
+        __setMoveZhStr();
+    __writeInfo_PGN(wos);
+    switch (fmt) {
+    case RecFormat::PGN_ICCS:
     case RecFormat::PGN_ZH:
-        __writeInfo_PGN(wos);
-        __writeMove_PGN_ICCSZH(wos, RecFormat::PGN_ZH);
+        __writeMove_PGN_ICCSZH(wos, fmt);
         break;
     case RecFormat::PGN_CC:
-        __writeInfo_PGN(wos);
         __writeMove_PGN_CC(wos);
         break;
     default:
@@ -182,35 +455,159 @@ void Instance::write(const std::string& outfilename)
 
 const std::wstring& Instance::remark() const { return rootMove_->remark(); }
 
-const std::wstring Instance::toString()
+void Instance::toStream(std::wostream& wos)
 {
-    std::wostringstream wos{};
+    __setMoveZhStr();
     __writeInfo_PGN(wos);
     __writeMove_PGN_CC(wos);
 
+    // 文本棋盘只建一次，每步着法仅改写起止两个位置
+    auto curMove = currentMove_;
     backTo(rootMove_);
-    std::vector<std::shared_ptr<Move>> preMoves{};
-    std::function<void(bool)>
-        __printMoveBoard = [&](bool isOther) {
-            isOther ? goOther() : go();
-            wos << board_->toString() << currentMove_->toString() << L"\n\n";
-            if (currentMove_->other()) {
-                preMoves.push_back(currentMove_);
-                __printMoveBoard(true);
+    std::wstring textBoard{ board_->toString() };
+    auto __putMoveSeats = [&](const std::shared_ptr<Move>& move) {
+        Board::putTextSeat(textBoard, *move->fseat());
+        Board::putTextSeat(textBoard, *move->tseat());
+    };
+    std::function<void(const std::shared_ptr<Move>&)>
+        __writeMoveBoard = [&](const std::shared_ptr<Move>& move) {
+            move->done();
+            __putMoveSeats(move);
+            wos << textBoard << move->toString() << L"\n\n";
+            if (move->other()) {
+                move->undo();
+                __putMoveSeats(move);
+                __writeMoveBoard(move->other());
                 // 变着之前着在返回时，应予执行
-                if (!preMoves.empty()) {
-                    preMoves.back()->done();
-                    preMoves.pop_back();
-                }
+                move->done();
+                __putMoveSeats(move);
             }
-            if (currentMove_->next()) {
-                __printMoveBoard(false);
-            }
-            back();
+            if (move->next())
+                __writeMoveBoard(move->next());
+            move->undo();
+            __putMoveSeats(move);
         };
-    if (currentMove_->next())
-        __printMoveBoard(false);
+    if (rootMove_->next())
+        __writeMoveBoard(rootMove_->next());
+
+    if (curMove != rootMove_)
+        for (auto& move : curMove->getPrevMoves())
+            if (move != rootMove_)
+                move->done();
+    currentMove_ = curMove;
+}
+
+void Instance::toStream(std::ostream& os)
+{
+    // 按行转换后写出，不在内存中保存整个文本
+    class LineBuf : public std::wstreambuf {
+    public:
+        explicit LineBuf(std::ostream& os)
+            : os_(os)
+        {
+        }
+        ~LineBuf() { sync(); }
+
+    protected:
+        int_type overflow(int_type wch) override
+        {
+            if (wch == traits_type::eof())
+                return traits_type::not_eof(wch);
+            line_.push_back(traits_type::to_char_type(wch));
+            if (wch == L'\n')
+                sync();
+            return wch;
+        }
+        int sync() override
+        {
+            os_ << Tools::ws2s(line_);
+            line_.clear();
+            return os_ ? 0 : -1;
+        }
+
+    private:
+        std::ostream& os_;
+        std::wstring line_{};
+    } lineBuf{ os };
+    std::wostream wos{ &lineBuf };
+    toStream(wos);
+}
+
+const std::wstring Instance::toString()
+{
+    std::wostringstream wos{};
+    toStream(wos);
+    return wos.str();
+}
+
+const std::wstring Instance::getCanonical(const std::vector<RecFormat>& fmts) const
+{
+    // 依次按各格式可保存的信息取舍：XQF只有固定的几项且版本写为18，PGN信息行不能跨行
+    std::map<std::wstring, std::wstring> info{ info_ };
+    for (auto fmt : fmts)
+        if (fmt == RecFormat::XQF) {
+            auto __get = [&](const std::wstring& key) {
+                auto pos = info.find(key);
+                return pos == info.end() ? std::wstring{} : pos->second;
+            };
+            auto __getName = [&](const std::wstring& key, const std::vector<std::wstring>& names) {
+                auto pos = std::find(names.begin(), names.end(), __get(key));
+                return pos == names.end() ? names[0] : *pos;
+            };
+            // 同__writeXQF：按字节长度截短
+            auto __getField = [&](const std::wstring& key, size_t length) {
+                std::wstring wstr{ __get(key) };
+                while (Tools::ws2s(wstr).size() > length)
+                    wstr.pop_back();
+                return wstr;
+            };
+            std::wstring fen{ __get(L"FEN") };
+            info = std::map<std::wstring, std::wstring>{
+                { L"Version", L"18" },
+                { L"Result", __getName(L"Result", { L"未知", L"红胜", L"黑胜", L"和棋" }) },
+                { L"PlayType", __getName(L"PlayType", { L"全局", L"开局", L"中局", L"残局" }) },
+                { L"TitleA", __getField(L"TitleA", 64) },
+                { L"Event", __getField(L"Event", 64) },
+                { L"Date", __getField(L"Date", 16) },
+                { L"Site", __getField(L"Site", 16) },
+                { L"Red", __getField(L"Red", 16) },
+                { L"Black", __getField(L"Black", 16) },
+                { L"Opening", __getField(L"Opening", 64) },
+                { L"RMKWriter", __getField(L"RMKWriter", 16) },
+                { L"Author", __getField(L"Author", 16) },
+                { L"FEN", fen.substr(0, fen.find(L' ')) }
+            };
+        } else if (fmt == RecFormat::PGN_ICCS || fmt == RecFormat::PGN_ZH || fmt == RecFormat::PGN_CC) {
+            for (auto pos = info.begin(); pos != info.end();)
+                if (pos->second.find(L'\n') != std::wstring::npos
+                    || !std::all_of(pos->first.begin(), pos->first.end(),
+                           [](wchar_t ch) { return ch == L'_' || std::iswalnum(ch); }))
+                    pos = info.erase(pos);
+                else
+                    ++pos;
+        }
 
+    auto __escape = [](const std::wstring& str) {
+        std::wstring result{};
+        for (auto ch : str)
+            result += (ch == L'\n' ? std::wstring{ L"\\n" } : std::wstring(1, ch));
+        return result;
+    };
+    std::wostringstream wos{};
+    for (auto& kv : info)
+        wos << kv.first << L'=' << __escape(kv.second) << L'\n';
+    wos << L"0,0 {" << __escape(rootMove_->remark()) << L"}\n";
+    std::function<void(const std::shared_ptr<Move>&)>
+        __writeMove = [&](const std::shared_ptr<Move>& move) {
+            wos << move->nextNo() << L',' << move->otherNo() << L' ' << move->iccs()
+                << L" {" << __escape(move->remark()) << L"}\n";
+            if (move->next())
+                __writeMove(move->next());
+            if (move->other())
+                __writeMove(move->other());
+        };
+    if (rootMove_->next())
+        __writeMove(rootMove_->next());
     return wos.str();
 }
 
@@ -241,18 +638,114 @@ const std::wstring Instance::test()
     auto str2 = toString();
     changeSide(ChangeType::SYMMETRY);
     auto str3 = toString();
-    return str0 + str1 + str2 + str3;
+
+    std::wstringstream wss{};
+    // 其余格式写出再读回，规范文本应与写出前相同(只比较该格式能保存的信息)；01.XQF为示例棋谱，不可覆盖
+    for (auto& fileName : { "02.xqf", "01.fbin", "01.fjson", "01.cbin" }) {
+        auto canonical = getCanonical({ getRecFormat(Tools::getExt(fileName)) });
+        write(fileName);
+        read(fileName);
+        wss << fileName << L": " << (getCanonical() == canonical ? L"读回相同" : L"读回不同") << L'\n';
+    }
+
+    // 游标先序遍历全部着法，回到开始时局面复原
+    auto instance = std::make_shared<Instance>("01.pgn_cc");
+    Cursor cursor{ instance };
+    std::wstring pieceChars{ cursor.getPieceChars() };
+    int cursorCount{ 0 };
+    std::function<void()>
+        __traverse = [&]() {
+            if (!cursor.go())
+                return;
+            do {
+                ++cursorCount;
+                __traverse();
+            } while (cursor.goOther());
+            cursor.back();
+        };
+    __traverse();
+    wss << L"游标: 遍历" << cursorCount << L"/" << instance->getMovCount() << L"着, 局面"
+        << (cursor.isRoot() && cursor.getPieceChars() == pieceChars ? L"复原" : L"未复原") << L'\n';
+
+    // 编辑着法：两路换序到达同一局面，另增删一个变着、一个后续着法，统计数值应与重新读取的相同
+    Instance edit{};
+    std::wistringstream fenWis{ L"[FEN \"" + PieceManager::getFENStr() + L" r - - 0 1\"]\n\n" };
+    edit.read(fenWis, RecFormat::PGN_CC);
+    edit.addNext(27, 24, L"炮二平五"); // 炮二平五 马8进7 马二进三
+    edit.go();
+    edit.addNext(97, 76);
+    edit.go();
+    edit.addNext(7, 26);
+    edit.backTo(edit.rootMove_);
+    edit.addNext(7, 26, L"马二进三"); // 马二进三 马8进7 炮二平五
+    edit.go();
+    edit.goOther();
+    edit.addNext(97, 76);
+    edit.go();
+    edit.addNext(27, 24);
+    edit.go();
+    edit.addOther(27, 25);
+    edit.cutOther();
+    edit.addNext(96, 95, L"删去的着法");
+    edit.cutNext();
+    std::wstringstream pgnWss{};
+    edit.write(pgnWss, RecFormat::PGN_CC);
+    Instance fresh{};
+    fresh.read(pgnWss, RecFormat::PGN_CC);
+    bool sameNums{ edit.getMovCount() == fresh.getMovCount() && edit.getRemCount() == fresh.getRemCount()
+        && edit.getRemLenMax() == fresh.getRemLenMax() && edit.getMaxRow() == fresh.getMaxRow()
+        && edit.getMaxCol() == fresh.getMaxCol() && edit.getCanonical() == fresh.getCanonical() };
+    wss << L"编辑: 着法" << edit.getMovCount() << L" 注解" << edit.getRemCount() << L" 深度" << edit.getMaxRow()
+        << L" 宽度" << edit.getMaxCol() << L", 与重新读取的" << (sameNums ? L"相同" : L"不同") << L'\n';
+
+    Graph graph{ edit };
+    wss << L"局面图: 局面" << graph.getNodeCount() << L" 着法" << graph.getEdgeCount()
+        << L" 换序" << graph.getTransCount() << L'\n';
+
+    // 损坏的输入应抛出ParseError，而不是其他异常或崩溃
+    const std::vector<std::pair<std::string, RecFormat>> corrupts{
+        { "XQ", RecFormat::XQF },
+        { "{\"info\":", RecFormat::JSON },
+        { "CCFB", RecFormat::FBIN },
+        { "CCCB", RecFormat::CBIN },
+        { "[FEN \"rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RNBAKABNR r - - 0 1\"]\n\n1. 车九退一\n",
+            RecFormat::PGN_ZH }
+    };
+    for (auto& corrupt : corrupts) {
+        std::wstring result{ L"未抛出异常" };
+        try {
+            Instance instance{};
+            instance.read(corrupt.first.data(), corrupt.first.size(), corrupt.second);
+        } catch (const ParseError&) {
+            result = L"抛出ParseError";
+        } catch (const std::exception&) {
+            result = L"抛出其他异常";
+        }
+        wss << L"损坏的" << getExtName(corrupt.second).c_str() << L": " << result << L'\n';
+    }
+    return str0 + str1 + str2 + str3 + wss.str();
 }
 
 void Instance::__reset()
 {
-    info_ = std::map<std::wstring, std::wstring>{};
-    board_ = std::make_shared<Board>();
-    currentMove_ = rootMove_ = std::make_shared<Move>();
+    // 先释放旧着法，内存池才能从头复用；棋盘在读取时按初始局面重新摆放
+    info_.clear();
+    if (!board_)
+        board_ = std::make_shared<Board>();
+    currentMove_.reset();
+    rootMove_.reset();
+    if (!moveArena_)
+        moveArena_ = std::make_shared<MoveArena>();
+    moveArena_->rewind();
+    currentMove_ = rootMove_ = moveArena_->create();
     movCount_ = remCount_ = remLenMax_ = maxRow_ = maxCol_ = 0;
+    notationNanos_ = 0;
+    nextNoNums_.clear();
+    remLenNums_.clear();
+    zhStrValid_ = true;
 }
 
-void Instance::__readXQF(std::istream& is)
+void Instance::__readXQF(const char* data, const size_t size)
 {
     const int pieceNum{ 32 };
     char Signature[3]{}, Version{}, headKeyMask{}, ProductId[4]{}, //文件标记'XQ'=$5158/版本/加密掩码/ProductId[4], 产品(厂商的产品号)
@@ -271,40 +764,30 @@ void Instance::__readXQF(std::istream& is)
         Opening[65]{}, Redtime[17]{}, Blktime[17]{}, Reservedh[33]{},
         RMKWriter[17]{}, Author[17]{}; //, Other[528]{}; // 棋谱评论员/文件的作者
 
-    is.read(Signature, 2).get(Version).get(headKeyMask).read(ProductId, 4) // = 8 bytes
-        .get(headKeyOrA)
-        .get(headKeyOrB)
-        .get(headKeyOrC)
-        .get(headKeyOrD)
-        .get(headKeysSum)
-        .get(headKeyXY)
-        .get(headKeyXYf)
-        .get(headKeyXYt) // = 16 bytes
-        .read(headQiziXY, pieceNum) // = 48 bytes
-        .read(PlayStepNo, 2)
-        .get(headWhoPlay)
-        .get(headPlayResult)
-        .read(PlayNodes, 4)
-        .read(PTreePos, 4)
-        .read(Reserved1, 4) // = 64 bytes
-        .read(headCodeA_H, 16)
-        .read(TitleA, 64)
-        .read(TitleB, 64)
-        .read(Event, 64)
-        .read(Date, 16)
-        .read(Site, 16)
-        .read(Red, 16)
-        .read(Black, 16)
-        .read(Opening, 64)
-        .read(Redtime, 16)
-        .read(Blktime, 16)
-        .read(Reservedh, 32)
-        .read(RMKWriter, 16)
-        .read(Author, 16);
-
-    assert(Signature[0] == 0x58 || Signature[1] == 0x51);
-    assert((headKeysSum + headKeyXY + headKeyXYf + headKeyXYt) % 256 == 0); // L" 检查密码校验和不对，不等于0。\n";
-    assert(Version <= 18); // L" 这是一个高版本的XQF文件，您需要更高版本的XQStudio来读取这个文件。\n";
+    size_t pos{ 0 };
+    // 从缓冲区顺序读取，超出文件长度的部分保持为0
+    auto __read = [&](char* bytes, size_t length) {
+        size_t count{ pos < size ? std::min(length, size - pos) : 0 };
+        std::copy(data + pos, data + pos + count, bytes);
+        pos += length;
+    };
+    __read(Signature, 2), __read(&Version, 1), __read(&headKeyMask, 1), __read(ProductId, 4); // = 8 bytes
+    __read(&headKeyOrA, 1), __read(&headKeyOrB, 1), __read(&headKeyOrC, 1), __read(&headKeyOrD, 1);
+    __read(&headKeysSum, 1), __read(&headKeyXY, 1), __read(&headKeyXYf, 1), __read(&headKeyXYt, 1); // = 16 bytes
+    __read(headQiziXY, pieceNum); // = 48 bytes
+    __read(PlayStepNo, 2), __read(&headWhoPlay, 1), __read(&headPlayResult, 1);
+    __read(PlayNodes, 4), __read(PTreePos, 4), __read(Reserved1, 4); // = 64 bytes
+    __read(headCodeA_H, 16), __read(TitleA, 64), __read(TitleB, 64), __read(Event, 64);
+    __read(Date, 16), __read(Site, 16), __read(Red, 16), __read(Black, 16);
+    __read(Opening, 64), __read(Redtime, 16), __read(Blktime, 16), __read(Reservedh, 32);
+    __read(RMKWriter, 16), __read(Author, 16);
+
+    if (Signature[0] != 0x58 || Signature[1] != 0x51)
+        throw ParseError("XQF文件标记不是'XQ'");
+    if ((headKeysSum + headKeyXY + headKeyXYf + headKeyXYt) % 256 != 0)
+        throw ParseError("XQF密码校验和不对，不等于0");
+    if (Version > 18)
+        throw ParseError("XQF文件版本高于18");
 
     unsigned char KeyXY{}, KeyXYf{}, KeyXYt{}, F32Keys[pieceNum], *head_QiziXY{ (unsigned char*)headQiziXY };
     int KeyRMKSize{};
@@ -365,14 +848,19 @@ void Instance::__readXQF(std::istream& is)
         __sub = [](unsigned char a, unsigned char b) {
             return a - b;
         }; // 保持为<256
-    auto __readBytes = [&](char* bytes, int size) {
-        int pos = is.tellg();
-        is.read(bytes, size);
-        if (Version > 10) // '字节解密'
-            for (int i = 0; i != size; ++i)
-                bytes[i] = __sub(bytes[i], F32Keys[(pos + i) % 32]);
+    // 着法区整体解密：起点1024为32的倍数，密钥序号即为缓冲区序号按32循环
+    const size_t moveBegin{ 1024 };
+    std::vector<unsigned char> moveBytes(data + std::min(moveBegin, size), data + size);
+    if (Version > 10) // '字节解密'
+        for (size_t i = 0; i != moveBytes.size(); ++i)
+            moveBytes[i] -= F32Keys[i % 32];
+    pos = 0;
+    auto __readBytes = [&](char* bytes, int length) {
+        size_t count{ pos < moveBytes.size() ? std::min(static_cast<size_t>(length), moveBytes.size() - pos) : 0 };
+        std::fill(std::copy(moveBytes.begin() + pos, moveBytes.begin() + pos + count, bytes), bytes + length, 0);
+        pos += length;
     };
-    char data[4]{}, &frc{ data[0] }, &trc{ data[1] }, &tag{ data[2] };
+    char mdata[4]{}, &frc{ mdata[0] }, &trc{ mdata[1] }, &tag{ mdata[2] };
     auto __getRemarksize = [&]() {
         char clen[4]{};
         __readBytes(clen, 4);
@@ -380,7 +868,7 @@ void Instance::__readXQF(std::istream& is)
     };
     std::function<std::wstring()>
         __readDataAndGetRemark = [&]() {
-            __readBytes(data, 4);
+            __readBytes(mdata, 4);
             int RemarkSize{};
             if (Version <= 10) {
                 tag = ((tag & 0xF0) ? 0x80 : 0) | ((tag & 0x0F) ? 0x40 : 0);
@@ -390,10 +878,11 @@ void Instance::__readXQF(std::istream& is)
                 if (tag & 0x20)
                     RemarkSize = __getRemarksize();
             }
-            if (RemarkSize > 0) { // # 如果有注解
-                char rem[RemarkSize + 1]{};
-                __readBytes(rem, RemarkSize);
-                return Tools::s2ws(rem);
+            if (RemarkSize > 0 && pos < moveBytes.size()) { // # 如果有注解（长度不超出文件）
+                auto remBegin = moveBytes.begin() + pos,
+                     remEnd = remBegin + std::min(static_cast<size_t>(RemarkSize), moveBytes.size() - pos);
+                pos += RemarkSize;
+                return Tools::s2ws(std::string(remBegin, std::find(remBegin, remEnd, 0)));
             } else
                 return std::wstring{};
         };
@@ -402,7 +891,8 @@ void Instance::__readXQF(std::istream& is)
             auto remark = __readDataAndGetRemark();
             //# 一步棋的起点和终点有简单的加密计算，读入时需要还原
             int fcolrow = __sub(frc, 0X18 + KeyXYf), tcolrow = __sub(trc, 0X20 + KeyXYt);
-            assert(fcolrow <= 89 && tcolrow <= 89);
+            if (fcolrow > 89 || tcolrow > 89)
+                throw ParseError("XQF着法位置超出棋盘");
             __setMoveFromRowcol(move, (fcolrow % 10) * 10 + fcolrow / 10,
                 (tcolrow % 10) * 10 + tcolrow / 10, remark);
 
@@ -413,28 +903,140 @@ void Instance::__readXQF(std::istream& is)
                 __readMove(move->addOther());
         };
 
-    is.seekg(1024);
     rootMove_->setRemark(__readDataAndGetRemark());
     char rtag{ tag };
     if (rtag & 0x80) //# 有左子树
         __readMove(rootMove_->addNext());
 }
 
+void Instance::__writeXQF(std::ostream& os) const
+{
+    const int pieceNum{ 32 };
+    // 固定的钥匙使同一棋谱总是写出相同的文件；校验和：四个钥匙之和为256的倍数
+    const unsigned char headKeyMask{ 0xA5 }, headKeyOrA{ 0x15 }, headKeyOrB{ 0x2A },
+        headKeyOrC{ 0x44 }, headKeyOrD{ 0x0B },
+        headKeyXY{ 0x35 }, headKeyXYf{ 0x7A }, headKeyXYt{ 0x56 },
+        headKeysSum = 256 - (headKeyXY + headKeyXYf + headKeyXYt) % 256;
+    std::string data(1024, '\0'); // 文件头1024字节，着法区随后追加，一次写出
+    data[0] = 'X', data[1] = 'Q', data[2] = 18, data[3] = headKeyMask;
+    data[8] = headKeyOrA, data[9] = headKeyOrB, data[10] = headKeyOrC, data[11] = headKeyOrD;
+    data[12] = headKeysSum, data[13] = headKeyXY, data[14] = headKeyXYf, data[15] = headKeyXYt;
+
+    std::function<unsigned char(unsigned char, unsigned char)> __calkey = [](unsigned char bKey, unsigned char cKey) {
+        return (((((bKey * bKey) * 3 + 9) * 3 + 8) * 2 + 1) * 3 + 8) * cKey; // % 256; // 保持为<256
+    };
+    unsigned char KeyXY{ __calkey(headKeyXY, headKeyXY) }, KeyXYf{ __calkey(headKeyXYf, KeyXY) },
+        KeyXYt{ __calkey(headKeyXYt, KeyXYf) }, F32Keys[pieceNum];
+    int KeyRMKSize{ (headKeysSum * 256 + headKeyXY) % 32000 + 767 };
+    int KeyBytes[4]{
+        (headKeysSum & headKeyMask) | headKeyOrA,
+        (headKeyXY & headKeyMask) | headKeyOrB,
+        (headKeyXYf & headKeyMask) | headKeyOrC,
+        (headKeyXYt & headKeyMask) | headKeyOrD
+    };
+    const std::string copyright{ "[(C) Copyright Mr. Dong Shiwei.]" };
+    for (int i = 0; i != pieceNum; ++i)
+        F32Keys[i] = copyright[i] & KeyBytes[i % 4];
+
+    // 棋子位置：按QiziXY设定的棋子顺序依次占位，缺少的棋子位置为0xFF
+    unsigned char QiziXY[pieceNum];
+    std::fill(std::begin(QiziXY), std::end(QiziXY), 0xFF);
+    std::wstring pieceChars{ __pieceChars() },
+        pieChars = L"RNBAKABNRCCPPPPPrnbakabnrccppppp";
+    for (int index = 0; index != static_cast<int>(pieceChars.size()); ++index) {
+        if (pieceChars[index] == PieceManager::nullChar())
+            continue;
+        int i{ 0 };
+        while (i != pieceNum && (pieChars[i] != pieceChars[index] || QiziXY[i] != 0xFF))
+            ++i;
+        if (i == pieceNum) // 某种棋子多于其在开局时的个数，XQF无处存放
+            throw ParseError("局面中的棋子超出XQF可存放的个数");
+        QiziXY[i] = index % 9 * 10 + index / 9; // 十位数为X(0-8),个位数为Y(0-9)
+    }
+    for (int i = 0; i != pieceNum; ++i) // 版本>=12：棋子位置循环移动并加密
+        data[16 + i] = QiziXY[(i + KeyXY + 1) % pieceNum] + KeyXY;
+
+    data[50] = (rootMove_->next() && rootMove_->next()->fseat()
+                       && rootMove_->next()->fseat()->piece()->color() == PieceColor::BLACK)
+        ? 1
+        : 0;
+    auto __getCode = [&](const std::wstring& key, const std::vector<std::wstring>& names) {
+        auto pos = info_.find(key);
+        auto npos = pos == info_.end() ? names.end() : std::find(names.begin(), names.end(), pos->second);
+        return npos == names.end() ? 0 : npos - names.begin();
+    };
+    data[51] = __getCode(L"Result", { L"未知", L"红胜", L"黑胜", L"和棋" });
+    data[64] = __getCode(L"PlayType", { L"全局", L"开局", L"中局", L"残局" });
+    // 超出字段长度的字符串按字符截短，避免截断多字节字符
+    auto __putInfo = [&](const std::wstring& key, int offset, size_t length) {
+        auto pos = info_.find(key);
+        if (pos == info_.end())
+            return;
+        std::wstring wstr{ pos->second };
+        std::string str{ Tools::ws2s(wstr) };
+        while (str.size() > length) {
+            wstr.pop_back();
+            str = Tools::ws2s(wstr);
+        }
+        std::copy(str.begin(), str.end(), data.begin() + offset);
+    };
+    __putInfo(L"TitleA", 80, 64), __putInfo(L"Event", 208, 64);
+    __putInfo(L"Date", 272, 16), __putInfo(L"Site", 288, 16);
+    __putInfo(L"Red", 304, 16), __putInfo(L"Black", 320, 16);
+    __putInfo(L"Opening", 336, 64), __putInfo(L"RMKWriter", 464, 16), __putInfo(L"Author", 480, 16);
+
+    auto __putDataAndRemark = [&](int frc, int trc, char tag, const std::wstring& remark) {
+        std::string rem{ Tools::ws2s(remark) };
+        if (!rem.empty())
+            tag |= 0x20;
+        data.push_back(frc), data.push_back(trc), data.push_back(tag), data.push_back(0);
+        if (tag & 0x20) {
+            int clen{ static_cast<int>(rem.size()) + KeyRMKSize };
+            data.append((char*)&clen, 4).append(rem);
+        }
+    };
+    std::function<void(const std::shared_ptr<Move>&)>
+        __writeMove = [&](const std::shared_ptr<Move>& move) {
+            //# 一步棋的起点和终点有简单的加密计算
+            int frowcol{ move->frowcol() }, trowcol{ move->trowcol() };
+            __putDataAndRemark((frowcol % 10 * 10 + frowcol / 10) + 0X18 + KeyXYf,
+                (trowcol % 10 * 10 + trowcol / 10) + 0X20 + KeyXYt,
+                (move->next() ? 0x80 : 0x00) | (move->other() ? 0x40 : 0x00), move->remark());
+            if (move->next())
+                __writeMove(move->next());
+            if (move->other())
+                __writeMove(move->other());
+        };
+
+    __putDataAndRemark(0, 0, rootMove_->next() ? 0x80 : 0x00, rootMove_->remark());
+    if (rootMove_->next())
+        __writeMove(rootMove_->next());
+    // 着法区整体加密：起点1024为32的倍数，密钥序号即为缓冲区序号按32循环
+    for (size_t i = 1024; i != data.size(); ++i)
+        data[i] += F32Keys[i % 32];
+    os.write(data.data(), data.size());
+}
+
 void Instance::__readBIN(std::istream& is)
 {
+    const int maxLength{ 1 << 24 };
     char len[sizeof(int)]{};
     std::function<std::wstring()> __readWstring = [&]() {
         is.read(len, sizeof(int));
         int length{ *(int*)len };
-        char rem[length + 1]{};
-        is.read(rem, length);
+        if (!is || length < 0 || length > maxLength)
+            throw ParseError("BIN字符串长度有误");
+        std::string rem(length, '\0');
+        if (!is.read(&rem[0], length))
+            throw ParseError("BIN文件不完整");
         return Tools::s2ws(rem);
     };
     char frowcol{}, trowcol{};
     std::function<void(const std::shared_ptr<Move>&)>
         __readMove = [&](const std::shared_ptr<Move>& move) {
             char tag{};
-            is.get(frowcol).get(trowcol).get(tag);
+            if (!is.get(frowcol).get(trowcol).get(tag))
+                throw ParseError("BIN文件不完整");
             __setMoveFromRowcol(move, frowcol, trowcol, (tag & 0x20) ? __readWstring() : L"");
 
             if (tag & 0x80)
@@ -505,62 +1107,367 @@ void Instance::__writeBIN(std::ostream& os) const
 
 void Instance::__readJSON(std::istream& is)
 {
-    Json::CharReaderBuilder builder;
-    Json::Value root;
-    JSONCPP_STRING errs;
-    if (!parseFromStream(builder, is, &root, &errs))
-        return;
-
-    Json::Value infoItem{ root["info"] };
-    for (auto& key : infoItem.getMemberNames())
-        info_[Tools::s2ws(key)] = Tools::s2ws(infoItem[key].asString());
-    board_->reset(__pieceChars());
-
-    std::function<void(const std::shared_ptr<Move>&, Json::Value&)>
-        __readMove = [&](const std::shared_ptr<Move>& move, Json::Value& item) {
-            int frowcol{ item["f"].asInt() }, trowcol{ item["t"].asInt() };
-            __setMoveFromRowcol(move, frowcol, trowcol,
-                (item.isMember("r")) ? Tools::s2ws(item["r"].asString()) : L"");
+    // 按棋谱结构边读边建立着法树，不生成中间文档；不合JSON语法处即抛出ParseError
+    std::istreambuf_iterator<char> iter{ is }, end{};
+    auto __error = []() { throw ParseError("JSON格式有误"); };
+    auto __peek = [&]() {
+        while (iter != end && std::isspace(static_cast<unsigned char>(*iter)))
+            ++iter;
+        return iter != end ? *iter : '\0';
+    };
+    auto __get = [&](char ch) {
+        bool isMatch{ __peek() == ch };
+        if (isMatch)
+            ++iter;
+        return isMatch;
+    };
+    auto __expect = [&](char ch) {
+        if (!__get(ch))
+            __error();
+    };
+    auto __isDelimiter = [](char ch) {
+        return std::isspace(static_cast<unsigned char>(ch)) || std::string{ ",:{}[]\"" }.find(ch) != std::string::npos;
+    };
+    auto __putUTF8 = [](std::string& str, unsigned int code) {
+        if (code < 0x80)
+            str += static_cast<char>(code);
+        else if (code < 0x800)
+            str += static_cast<char>(0xC0 | (code >> 6)), str += static_cast<char>(0x80 | (code & 0x3F));
+        else if (code < 0x10000)
+            str += static_cast<char>(0xE0 | (code >> 12)), str += static_cast<char>(0x80 | ((code >> 6) & 0x3F)),
+                str += static_cast<char>(0x80 | (code & 0x3F));
+        else
+            str += static_cast<char>(0xF0 | (code >> 18)), str += static_cast<char>(0x80 | ((code >> 12) & 0x3F)),
+                str += static_cast<char>(0x80 | ((code >> 6) & 0x3F)), str += static_cast<char>(0x80 | (code & 0x3F));
+    };
+    auto __readHex = [&]() {
+        unsigned int code{ 0 };
+        for (int i = 0; i != 4; ++i, ++iter) {
+            size_t digit{ iter == end ? std::string::npos : std::string{ "0123456789abcdef" }.find(std::tolower(*iter)) };
+            if (digit == std::string::npos)
+                __error();
+            code = code * 16 + digit;
+        }
+        return code;
+    };
+    // 字符串值转义后返回；数值、true等非字符串值按原文返回
+    auto __readString = [&]() {
+        std::string str{};
+        if (!__get('"')) {
+            while (iter != end && !__isDelimiter(*iter))
+                str += *iter++;
+            // 非字符串值只能是数值或true、false、null
+            if (str != "true" && str != "false" && str != "null") {
+                char* numEnd{};
+                std::strtod(str.c_str(), &numEnd);
+                if (str.empty() || *numEnd != '\0')
+                    __error();
+            }
+            return str;
+        }
+        while (iter != end && *iter != '"') {
+            char ch{ *iter++ };
+            if (ch != '\\') {
+                str += ch;
+                continue;
+            }
+            if (iter == end)
+                __error();
+            ch = *iter++;
+            switch (ch) {
+            case 'b':
+                str += '\b';
+                break;
+            case 'f':
+                str += '\f';
+                break;
+            case 'n':
+                str += '\n';
+                break;
+            case 'r':
+                str += '\r';
+                break;
+            case 't':
+                str += '\t';
+                break;
+            case 'u': { // 与jsoncpp相同，转换为UTF-8字节
+                unsigned int code{ __readHex() };
+                if (code >= 0xD800 && code <= 0xDBFF && iter != end && *iter == '\\') {
+                    if (++iter == end || *iter++ != 'u')
+                        __error();
+                    code = 0x10000 + ((code & 0x3FF) << 10) + (__readHex() & 0x3FF);
+                }
+                __putUTF8(str, code);
+                break;
+            }
+            case '"':
+            case '\\':
+            case '/':
+                str += ch;
+                break;
+            default:
+                __error();
+            }
+        }
+        if (iter == end)
+            __error();
+        ++iter;
+        return str;
+    };
+    auto __readInt = [&]() {
+        std::string str{ __readString() };
+        return str.empty() ? 0 : std::atoi(str.c_str());
+    };
+    auto __readKey = [&]() {
+        if (__peek() != '"')
+            __error();
+        std::string key{ __readString() };
+        __expect(':');
+        return key;
+    };
+    std::function<void()>
+        __skipValue = [&]() {
+            char open{ __peek() };
+            if (open != '{' && open != '[') {
+                __readString();
+                return;
+            }
+            char close{ open == '{' ? '}' : ']' };
+            ++iter;
+            if (__get(close))
+                return;
+            do {
+                if (open == '{')
+                    __readKey();
+                __skipValue();
+            } while (__get(','));
+            __expect(close);
+        };
+    // 值不是对象时略过
+    auto __readObject = [&](const std::function<void(const std::string&)>& readValue) {
+        if (__peek() != '{') {
+            __skipValue();
+            return;
+        }
+        ++iter;
+        if (__get('}'))
+            return;
+        do {
+            std::string key{ __readKey() };
+            readValue(key);
+        } while (__get(','));
+        __expect('}');
+    };
 
-            if (item.isMember("n"))
-                __readMove(move->addNext(), item["n"]);
-            if (item.isMember("o"))
-                __readMove(move->addOther(), item["o"]);
+    // 成员可按任意顺序出现：着法的起止位置在读完本对象后设置
+    std::function<void(const std::shared_ptr<Move>&)>
+        __readMove = [&](const std::shared_ptr<Move>& move) {
+            int frowcol{}, trowcol{};
+            std::string remark{};
+            __readObject([&](const std::string& key) {
+                if (key == "f")
+                    frowcol = __readInt();
+                else if (key == "t")
+                    trowcol = __readInt();
+                else if (key == "r")
+                    remark = __readString();
+                else if (key == "n" && __peek() == '{')
+                    __readMove(move->addNext());
+                else if (key == "o" && __peek() == '{')
+                    __readMove(move->addOther());
+                else
+                    __skipValue();
+            });
+            __setMoveFromRowcol(move, frowcol, trowcol, Tools::s2ws(remark));
         };
 
-    rootMove_->setRemark(Tools::s2ws(root["remark"].asString()));
-    Json::Value rootItem{ root["moves"] };
-    if (!rootItem.isNull())
-        __readMove(rootMove_->addNext(), rootItem);
+    // 扁平格式：着法按先序排列，p为前一局面着法的序号(-1为开局)，同一p的着法依次为变着
+    auto __readMoveArray = [&]() {
+        std::vector<std::shared_ptr<Move>> moves{}, lastMoves{ nullptr }; // lastMoves[p + 1]：p的最后一个后续着法
+        __expect('[');
+        if (!__get(']')) {
+            do {
+                if (__peek() != '{')
+                    __error();
+                int frowcol{}, trowcol{}, prevIndex{ -1 };
+                std::string remark{};
+                __readObject([&](const std::string& key) {
+                    if (key == "f")
+                        frowcol = __readInt();
+                    else if (key == "t")
+                        trowcol = __readInt();
+                    else if (key == "p")
+                        prevIndex = __readInt();
+                    else if (key == "r")
+                        remark = __readString();
+                    else
+                        __skipValue();
+                });
+                if (prevIndex < -1 || prevIndex >= static_cast<int>(moves.size()))
+                    throw ParseError("JSON着法的前一着法不存在");
+                auto& lastMove = lastMoves[prevIndex + 1];
+                auto move = (lastMove ? lastMove->addOther()
+                                      : (prevIndex < 0 ? rootMove_ : moves[prevIndex])->addNext());
+                __setMoveFromRowcol(move, frowcol, trowcol, Tools::s2ws(remark));
+                lastMove = move;
+                moves.push_back(move);
+                lastMoves.push_back(nullptr);
+            } while (__get(','));
+            __expect(']');
+        }
+    };
+
+    if (__peek() != '{')
+        __error();
+    __readObject([&](const std::string& key) {
+        if (key == "info")
+            __readObject([&](const std::string& key) {
+                info_[Tools::s2ws(key)] = Tools::s2ws(__readString());
+            });
+        else if (key == "remark")
+            rootMove_->setRemark(Tools::s2ws(__readString()));
+        else if (key == "moves" && __peek() == '{')
+            __readMove(rootMove_->addNext());
+        else if (key == "moves" && __peek() == '[')
+            __readMoveArray();
+        else
+            __skipValue();
+    });
+    __peek();
+    if (iter != end) // 对象之后只能有空白
+        __error();
+    board_->reset(__pieceChars());
 }
 
-void Instance::__writeJSON(std::ostream& os) const
+void Instance::__writeJSON(std::ostream& os, RecFormat fmt) const
 {
-    Json::Value root{}, infoItem{};
-    Json::StreamWriterBuilder builder;
-    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
-    std::for_each(info_.begin(), info_.end(),
-        [&](const std::pair<std::wstring, std::wstring>& kv) {
-            infoItem[Tools::ws2s(kv.first)] = Tools::ws2s(kv.second);
-        });
-    root["info"] = infoItem;
-    std::function<Json::Value(const std::shared_ptr<Move>&)>
-        __writeItem = [&](const std::shared_ptr<Move>& move) {
-            Json::Value item{};
-            item["f"] = move->frowcol();
-            item["t"] = move->trowcol();
-            if (!move->remark().empty())
-                item["r"] = Tools::ws2s(move->remark());
-            if (move->next())
-                item["n"] = __writeItem(move->next());
-            if (move->other())
-                item["o"] = __writeItem(move->other());
-            return item;
+    // 直接写出与jsoncpp相同的缩进格式：成员按键名排序，对象值另起一行
+    std::string indent{};
+    auto __writeString = [&](const std::string& str) {
+        os << '"';
+        for (char ch : str)
+            switch (ch) {
+            case '"':
+                os << "\\\"";
+                break;
+            case '\\':
+                os << "\\\\";
+                break;
+            case '\b':
+                os << "\\b";
+                break;
+            case '\f':
+                os << "\\f";
+                break;
+            case '\n':
+                os << "\\n";
+                break;
+            case '\r':
+                os << "\\r";
+                break;
+            case '\t':
+                os << "\\t";
+                break;
+            default: // 其余控制字符用\u00XX，多字节UTF-8原样写出
+                if (static_cast<unsigned char>(ch) < 0x20)
+                    os << "\\u00" << "0123456789abcdef"[ch >> 4] << "0123456789abcdef"[ch & 0xF];
+                else
+                    os << ch;
+                break;
+            }
+        os << '"';
+    };
+    auto __writeKey = [&](const std::string& key, bool isFirst) {
+        os << (isFirst ? "\n" : ",\n") << indent;
+        __writeString(key);
+        os << " : ";
+    };
+    auto __beginObject = [&]() {
+        os << '\n'
+           << indent << '{';
+        indent += '\t';
+    };
+    auto __endObject = [&]() {
+        indent.pop_back();
+        os << '\n'
+           << indent << '}';
+    };
+    std::function<void(const std::shared_ptr<Move>&)>
+        __writeMove = [&](const std::shared_ptr<Move>& move) {
+            __beginObject();
+            __writeKey("f", true);
+            os << std::to_string(move->frowcol());
+            if (move->next()) {
+                __writeKey("n", false);
+                __writeMove(move->next());
+            }
+            if (move->other()) {
+                __writeKey("o", false);
+                __writeMove(move->other());
+            }
+            if (!move->remark().empty()) {
+                __writeKey("r", false);
+                __writeString(Tools::ws2s(move->remark()));
+            }
+            __writeKey("t", false);
+            os << std::to_string(move->trowcol());
+            __endObject();
         };
-    root["remark"] = Tools::ws2s(rootMove_->remark());
-    if (rootMove_->next())
-        root["moves"] = __writeItem(rootMove_->next());
-    writer->write(root, &os);
+
+    os << '{';
+    indent += '\t';
+    __writeKey("info", true);
+    std::map<std::string, std::string> info{}; // 按转换后的字节排序
+    for (auto& kv : info_)
+        info[Tools::ws2s(kv.first)] = Tools::ws2s(kv.second);
+    if (info.empty())
+        os << "{}";
+    else {
+        __beginObject();
+        bool isFirst{ true };
+        for (auto& kv : info) {
+            __writeKey(kv.first, isFirst);
+            __writeString(kv.second);
+            isFirst = false;
+        }
+        __endObject();
+    }
+    if (fmt == RecFormat::FJSON) { // 扁平格式：每个着法一行，不嵌套
+        __writeKey("moves", false);
+        os << '\n'
+           << indent << '[';
+        std::vector<std::pair<std::shared_ptr<Move>, int>> moves{};
+        if (rootMove_->next())
+            moves.push_back({ rootMove_->next(), -1 });
+        for (int index = 0; !moves.empty(); ++index) {
+            auto move = moves.back().first;
+            int prevIndex{ moves.back().second };
+            moves.pop_back();
+            os << (index == 0 ? "\n" : ",\n") << indent << "\t{\"f\":" << std::to_string(move->frowcol())
+               << ",\"t\":" << std::to_string(move->trowcol()) << ",\"p\":" << std::to_string(prevIndex);
+            if (!move->remark().empty()) {
+                os << ",\"r\":";
+                __writeString(Tools::ws2s(move->remark()));
+            }
+            os << '}';
+            if (move->other())
+                moves.push_back({ move->other(), prevIndex });
+            if (move->next())
+                moves.push_back({ move->next(), index });
+        }
+        os << '\n'
+           << indent << ']';
+    } else if (rootMove_->next()) {
+        __writeKey("moves", false);
+        __writeMove(rootMove_->next());
+    }
+    __writeKey("remark", false);
+    __writeString(Tools::ws2s(rootMove_->remark()));
+    if (fmt == RecFormat::FJSON) {
+        __writeKey("version", false);
+        os << '2';
+    }
+    __endObject();
 }
 
 void Instance::__readInfo_PGN(std::wistream& wis)
@@ -579,39 +1486,30 @@ void Instance::__readMove_PGN_ICCSZH(std::wistream& wis, RecFormat fmt)
 {
     const std::wstring moveStr{ getWString(wis) };
     bool isPGN_ZH{ fmt == RecFormat::PGN_ZH };
-    std::wstring otherBeginStr{ LR"((\()?)" };
-    std::wstring boutStr{ LR"((\d+\.)?[\s...]*\b)" };
-    std::wstring ICCSZhStr{ LR"(([)"
-        + (isPGN_ZH ? PieceManager::getZhChars() : PieceManager::getICCSChars())
-        + LR"(]{4})\b)" };
-    std::wstring remarkStr{ LR"((?:\s*\{([\s\S]*?)\})?)" };
-    std::wstring otherEndStr{ LR"(\s*(\)+)?)" }; // 可能存在多个右括号
-    std::wregex moveReg{ otherBeginStr + boutStr + ICCSZhStr + remarkStr + otherEndStr },
-        remReg{ remarkStr + LR"(1\.)" };
-    std::wsmatch wsm{};
-    if (std::regex_search(moveStr, wsm, remReg))
-        rootMove_->setRemark(wsm.str(1));
+    auto __isMoveChar = [&](wchar_t ch) {
+        return (isPGN_ZH ? PieceManager::isZhChar(ch)
+                         : (ch >= L'0' && ch <= L'9') || (ch >= L'a' && ch <= L'i'));
+    };
+
+    // 单遍扫描：回合序号、省略号和空白略过，'('开始变着，')'结束变着，
+    // 紧随着法的'{...}'为其注解，第一着之前的为根注解
     std::shared_ptr<Move> preMove{ rootMove_ }, move{ rootMove_ };
     std::vector<std::shared_ptr<Move>> preOtherMoves{};
-    for (std::wsregex_iterator wtiMove{ moveStr.begin(), moveStr.end(), moveReg }, wtiEnd{};
-         wtiMove != wtiEnd; ++wtiMove) {
-        if ((*wtiMove)[1].matched) {
-            move = preMove->addOther();
-            preOtherMoves.push_back(preMove);
-            if (isPGN_ZH)
-                preMove->undo();
-        } else
-            move = preMove->addNext();
-        __setMoveFromStr(move, (*wtiMove)[3], fmt, (*wtiMove)[4]);
-        if (isPGN_ZH)
-            ; // std::wcout << (*wtiMove).str() << L'\n' << move->toString() << std::endl;
-        if (isPGN_ZH)
-            move->done(); // 推进board的状态变化
-        if (isPGN_ZH)
-            ; // std::wcout << board_->toString() << std::endl;
-
-        if ((*wtiMove)[5].matched)
-            for (int num = (*wtiMove).length(5); num > 0; --num) {
+    bool isOther{ false }, canRemark{ true };
+    for (size_t pos = 0, size = moveStr.size(); pos < size;) {
+        wchar_t ch{ moveStr[pos] };
+        if (ch == L'{') {
+            size_t endPos{ std::min(moveStr.find(L'}', pos + 1), size) };
+            if (canRemark)
+                move->setRemark(moveStr.substr(pos + 1, endPos - pos - 1));
+            canRemark = false;
+            pos = endPos + 1;
+        } else if (ch == L'(') {
+            isOther = true;
+            canRemark = false;
+            ++pos;
+        } else if (ch == L')') {
+            if (!preOtherMoves.empty()) {
                 preMove = preOtherMoves.back();
                 preOtherMoves.pop_back();
                 if (isPGN_ZH) {
@@ -621,8 +1519,31 @@ void Instance::__readMove_PGN_ICCSZH(std::wistream& wis, RecFormat fmt)
                     preMove->done();
                 }
             }
-        else
-            preMove = move;
+            canRemark = false;
+            ++pos;
+        } else if (__isMoveChar(ch)) {
+            size_t endPos{ pos };
+            while (endPos < size && __isMoveChar(moveStr[endPos]))
+                ++endPos;
+            // 恰为4个字符且其后不是'.'(回合序号)，即为着法
+            if (endPos - pos == 4 && (endPos == size || moveStr[endPos] != L'.')) {
+                if (isOther) {
+                    move = preMove->addOther();
+                    preOtherMoves.push_back(preMove);
+                    if (isPGN_ZH)
+                        preMove->undo();
+                    isOther = false;
+                } else
+                    move = preMove->addNext();
+                __setMoveFromStr(move, moveStr.substr(pos, 4), fmt);
+                if (isPGN_ZH)
+                    move->done(); // 推进board的状态变化
+                preMove = move;
+                canRemark = true;
+            }
+            pos = endPos;
+        } else
+            ++pos;
     }
     if (isPGN_ZH)
         while (move != rootMove_) {
@@ -671,52 +1592,79 @@ void Instance::__writeMove_PGN_ICCSZH(std::wostream& wos, RecFormat fmt) const
 void Instance::__readMove_PGN_CC(std::wistream& wis)
 {
     const std::wstring move_remStr{ getWString(wis) };
-    auto pos0 = move_remStr.find(L"\n("), pos1 = move_remStr.find(L"\n【");
-    std::wstring moveStr{ move_remStr.substr(0, std::min(pos0, pos1)) },
-        remStr{ move_remStr.substr(std::min(pos0, move_remStr.size()), pos1) };
-    std::wregex line_rg{ LR"(\n)" }, moveStrrg{ LR"(.{5})" },
-        moverg{ LR"(([^…　]{4}[…　]))" },
-        remrg{ LR"(\s*(\(\d+,\d+\)): \{([\s\S]*?)\})" };
-    std::map<std::wstring, std::wstring> rems{};
-    for (std::wsregex_iterator rp{ remStr.begin(), remStr.end(), remrg };
-         rp != std::wsregex_iterator{}; ++rp)
-        rems[(*rp)[1]] = (*rp)[2];
-
-    std::vector<std::vector<std::wstring>> moveLines{};
-    for (std::wsregex_token_iterator lineStrit{ moveStr.begin(), moveStr.end(), line_rg, -1 },
-         end{};
-         lineStrit != end; ++++lineStrit) {
-        std::vector<std::wstring> line{};
-        for (std::wsregex_token_iterator moveit{
-                 (*lineStrit).first, (*lineStrit).second, moveStrrg, 0 };
-             moveit != end; ++moveit)
-            line.push_back(*moveit);
-        moveLines.push_back(line);
+    const size_t size{ move_remStr.size() },
+        moveEnd{ std::min(move_remStr.find(L"\n("), move_remStr.find(L"\n【")) };
+    // 着法区为定宽字符网格：第2*row行为着法行，每格5个字符，按行列直接定位
+    std::vector<size_t> lineBegins{ 0 }, lineEnds{};
+    for (size_t pos = 0; pos < std::min(moveEnd, size); ++pos)
+        if (move_remStr[pos] == L'\n') {
+            lineEnds.push_back(pos);
+            lineBegins.push_back(pos + 1);
+        }
+    lineEnds.push_back(std::min(moveEnd, size));
+    int rowNum = (lineBegins.size() + 1) / 2, colNum{ 0 };
+    for (int line = 0; line < static_cast<int>(lineBegins.size()); line += 2)
+        colNum = std::max(colNum, static_cast<int>(lineEnds[line] - lineBegins[line]) / 5);
+    auto __getCell = [&](int row, int col) -> const wchar_t* {
+        if (row >= rowNum || col >= colNum)
+            return nullptr;
+        size_t begin{ lineBegins[2 * row] + 5 * col };
+        return begin + 5 <= lineEnds[2 * row] ? &move_remStr[begin] : nullptr;
+    };
+    auto __isMove = [](const wchar_t* cell) {
+        return std::none_of(cell, cell + 4, [](wchar_t ch) { return ch == L'…' || ch == L'　'; })
+            && (cell[4] == L'…' || cell[4] == L'　');
+    };
+
+    // 注解区顺序扫描一遍："(row,col): {remark}"，按行列存入
+    std::vector<std::wstring> rems(rowNum * colNum);
+    auto __readNum = [&](size_t& pos) {
+        int num{ -1 };
+        for (; pos < size && std::iswdigit(move_remStr[pos]); ++pos)
+            num = std::max(num, 0) * 10 + (move_remStr[pos] - L'0');
+        return num;
+    };
+    for (size_t pos = move_remStr.find(L'(', moveEnd); pos < size; pos = move_remStr.find(L'(', pos + 1)) {
+        size_t remPos{ pos + 1 };
+        int row{ __readNum(remPos) };
+        if (row < 0 || move_remStr.compare(remPos, 1, L",") != 0)
+            continue;
+        int col{ __readNum(++remPos) };
+        if (col < 0 || move_remStr.compare(remPos, 4, L"): {") != 0)
+            continue;
+        size_t remEnd{ move_remStr.find(L'}', remPos + 4) };
+        if (remEnd == std::wstring::npos)
+            break;
+        if (row < rowNum && col < colNum)
+            rems[row * colNum + col] = move_remStr.substr(remPos + 4, remEnd - remPos - 4);
+        pos = remEnd;
     }
+
     std::function<void(const std::shared_ptr<Move>&, int, int)>
         __readMove = [&](const std::shared_ptr<Move>& move, int row, int col) {
-            std::wstring zhStr{ moveLines[row][col] };
-            if (regex_match(zhStr, moverg)) {
-                __setMoveFromStr(move, zhStr.substr(0, 4), RecFormat::PGN_CC,
-                    rems[L'(' + std::to_wstring(row) + L',' + std::to_wstring(col) + L')']);
+            const wchar_t* cell{ __getCell(row, col) };
+            if (cell && __isMove(cell)) {
+                __setMoveFromStr(move, std::wstring(cell, 4), RecFormat::PGN_CC, rems[row * colNum + col]);
 
-                if (zhStr.back() == L'…')
+                if (cell[4] == L'…')
                     __readMove(move->addOther(), row, col + 1);
-                if (int(moveLines.size()) - 1 > row
-                    && moveLines[row + 1][col][0] != L'　') {
+                const wchar_t* nextCell{ __getCell(row + 1, col) };
+                if (nextCell && nextCell[0] != L'　') {
                     move->done();
                     __readMove(move->addNext(), row + 1, col);
                     move->undo();
                 }
-            } else if (moveLines[row][col][0] == L'…') {
-                while (moveLines[row][++col][0] == L'…')
+            } else if (cell && cell[0] == L'…') {
+                while ((cell = __getCell(row, ++col)) && cell[0] == L'…')
                     ;
                 __readMove(move, row, col);
             }
         };
 
-    rootMove_->setRemark(rems[L"(0,0)"]);
-    if (!moveLines.empty())
+    if (!rems.empty())
+        rootMove_->setRemark(rems[0]);
+    const wchar_t* firstCell{ __getCell(1, 0) };
+    if (firstCell && __isMove(firstCell))
         __readMove(rootMove_->addNext(), 1, 0);
 }
 
@@ -758,6 +1706,11 @@ void Instance::__writeMove_PGN_CC(std::wostream& wos) const
 void Instance::__setMoveFromRowcol(const std::shared_ptr<Move>& move,
     int frowcol, int trowcol, const std::wstring& remark) const
 {
+    auto __isValid = [](int rowcol) {
+        return rowcol >= 0 && rowcol / 10 < SeatManager::RowNum() && rowcol % 10 < SeatManager::ColNum();
+    };
+    if (!__isValid(frowcol) || !__isValid(trowcol))
+        throw ParseError("着法位置超出棋盘");
     move->setFTSeat(board_->getSeat(frowcol), board_->getSeat(trowcol));
     move->setRemark(remark);
 }
@@ -778,32 +1731,147 @@ void Instance::__setMoveFromStr(const std::shared_ptr<Move>& move,
 
 void Instance::__setMoveZhStrAndNums()
 {
-    std::function<void(const std::shared_ptr<Move>&)>
-        __setZhStrAndNums = [&](const std::shared_ptr<Move>& move) {
-            ++movCount_;
-            maxCol_ = std::max(maxCol_, move->otherNo());
-            maxRow_ = std::max(maxRow_, move->nextNo());
-            move->setCC_ColNo(maxCol_); // # 本着在视图中的列数
-            if (!move->remark().empty()) {
-                ++remCount_;
-                remLenMax_ = std::max(remLenMax_, static_cast<int>(move->remark().size()));
-            }
+    auto start = std::chrono::steady_clock::now();
+    std::function<void(const std::shared_ptr<Move>&, bool)>
+        __setZhStrAndNums = [&](const std::shared_ptr<Move>& move, bool isOther) {
+            if (!move->fseat() || !move->tseat() || !move->fseat()->piece())
+                throw ParseError("着法起点没有棋子");
+            __countMove(move, isOther, 1);
             move->setZhStr(board_->getZhStr(move->fseat(), move->tseat()));
 
             move->done();
             if (move->next())
-                __setZhStrAndNums(move->next());
+                __setZhStrAndNums(move->next(), false);
             move->undo();
 
+            if (move->other())
+                __setZhStrAndNums(move->other(), true);
+        };
+
+    movCount_ = remCount_ = remLenMax_ = maxRow_ = maxCol_ = 0;
+    notationNanos_ = 0;
+    nextNoNums_.clear();
+    remLenNums_.clear();
+    if (rootMove_->next())
+        __setZhStrAndNums(rootMove_->next(), false); // 驱动函数
+    __setMaxNums();
+    zhStrValid_ = true;
+    __setMoveCC_ColNo();
+    notationNanos_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start)
+                         .count();
+}
+
+// 读入后整体设置视图列数，编辑着法时由__shiftCC_ColNo增量调整
+void Instance::__setMoveCC_ColNo()
+{
+    int colNo{ 0 };
+    std::function<void(const std::shared_ptr<Move>&)>
+        __setCC_ColNo = [&](const std::shared_ptr<Move>& move) {
+            move->setCC_ColNo(colNo); // # 本着在视图中的列数
+            if (move->next())
+                __setCC_ColNo(move->next());
             if (move->other()) {
-                ++maxCol_;
-                __setZhStrAndNums(move->other());
+                ++colNo;
+                __setCC_ColNo(move->other());
             }
         };
 
-    movCount_ = remCount_ = remLenMax_ = maxRow_ = maxCol_ = 0;
     if (rootMove_->next())
-        __setZhStrAndNums(rootMove_->next()); // 驱动函数
+        __setCC_ColNo(rootMove_->next());
+}
+
+// 先序排列中位于move之后的全部着法(withOther为真时含move的变着)，视图列数增减inc
+void Instance::__shiftCC_ColNo(const std::shared_ptr<Move>& move, bool withOther, int inc)
+{
+    if (inc == 0)
+        return;
+    std::function<void(const std::shared_ptr<Move>&)>
+        __shift = [&](const std::shared_ptr<Move>& move) {
+            move->setCC_ColNo(move->CC_ColNo() + inc);
+            if (move->next())
+                __shift(move->next());
+            if (move->other())
+                __shift(move->other());
+        };
+    if (withOther && move->other())
+        __shift(move->other());
+    // 逐级上溯：从前着经后续着法到达时，前着的变着均在其后
+    for (auto cur = move, prev = move->prev(); prev; cur = prev, prev = prev->prev())
+        if (prev->next() == cur && prev->other())
+            __shift(prev->other());
+}
+
+// move及其后续着法(不含move的变着)中，先序排列的最后一个着法
+const std::shared_ptr<Instance::Move> Instance::__lastMove(const std::shared_ptr<Move>& move)
+{
+    std::shared_ptr<Move> last{ move };
+    while (last->next()) {
+        last = last->next();
+        while (last->other())
+            last = last->other();
+    }
+    return last;
+}
+
+// 增(inc=1)减(inc=-1)一个着法对统计数值的影响
+void Instance::__countMove(const std::shared_ptr<Move>& move, bool isOther, int inc)
+{
+    auto __addNum = [&](std::map<int, int>& nums, int key) {
+        if ((nums[key] += inc) == 0)
+            nums.erase(key);
+    };
+    movCount_ += inc;
+    if (isOther)
+        maxCol_ += inc;
+    __addNum(nextNoNums_, move->nextNo());
+    if (!move->remark().empty()) {
+        remCount_ += inc;
+        __addNum(remLenNums_, move->remark().size());
+    }
+}
+
+// 增减着法及其后续着法(withOther为真时含其全部变着)
+void Instance::__countMoves(const std::shared_ptr<Move>& move, bool isOther, bool withOther, int inc)
+{
+    __countMove(move, isOther, inc);
+    if (move->next())
+        __countMoves(move->next(), false, true, inc);
+    if (withOther && move->other())
+        __countMoves(move->other(), true, true, inc);
+}
+
+void Instance::__setMaxNums()
+{
+    maxRow_ = nextNoNums_.empty() ? 0 : nextNoNums_.rbegin()->first;
+    remLenMax_ = remLenNums_.empty() ? 0 : remLenNums_.rbegin()->first;
+}
+
+void Instance::__setMoveZhStr()
+{
+    if (zhStrValid_)
+        return;
+    std::function<void(const std::shared_ptr<Move>&)>
+        __setZhStr = [&](const std::shared_ptr<Move>& move) {
+            move->setZhStr(board_->getZhStr(move->fseat(), move->tseat()));
+            move->done();
+            if (move->next())
+                __setZhStr(move->next());
+            move->undo();
+            if (move->other())
+                __setZhStr(move->other());
+        };
+
+    auto curMove = currentMove_;
+    backTo(rootMove_);
+    if (rootMove_->next())
+        __setZhStr(rootMove_->next());
+    if (curMove != rootMove_)
+        for (auto& move : curMove->getPrevMoves())
+            if (move != rootMove_)
+                move->done();
+    currentMove_ = curMove;
+    zhStrValid_ = true;
 }
 
 void Instance::__setFEN(const std::wstring& pieceChars, PieceColor color)
@@ -814,7 +1882,10 @@ void Instance::__setFEN(const std::wstring& pieceChars, PieceColor color)
 
 const std::wstring Instance::__pieceChars() const
 {
-    std::wstring rfen{ info_.at(L"FEN") }, fen{ rfen.substr(0, rfen.find(L' ')) };
+    auto pos = info_.find(L"FEN");
+    if (pos == info_.end())
+        throw ParseError("棋谱缺少FEN");
+    std::wstring rfen{ pos->second }, fen{ rfen.substr(0, rfen.find(L' ')) };
     return FENTopieChars(fen);
 }
 
@@ -840,7 +1911,7 @@ const std::wstring Instance::Move::iccs() const
 
 const std::shared_ptr<Instance::Move>& Instance::Move::addNext()
 {
-    auto nextMove = std::make_shared<Move>();
+    auto nextMove = arena_->create();
     nextMove->setNextNo(nextNo_ + 1);
     nextMove->setOtherNo(otherNo_);
     nextMove->setPrev(std::weak_ptr<Move>(shared_from_this()));
@@ -849,7 +1920,7 @@ const std::shared_ptr<Instance::Move>& Instance::Move::addNext()
 
 const std::shared_ptr<Instance::Move>& Instance::Move::addOther()
 {
-    auto otherMove = std::make_shared<Move>();
+    auto otherMove = arena_->create();
     otherMove->setNextNo(nextNo_);
     otherMove->setOtherNo(otherNo_ + 1);
     otherMove->setPrev(std::weak_ptr<Move>(shared_from_this()));
@@ -887,6 +1958,101 @@ const std::wstring Instance::Move::toString() const
     return wss.str();
 }
 
+Instance::Cursor::Cursor(const std::shared_ptr<Instance>& instance)
+    : Cursor(__updated(instance))
+{
+}
+
+Instance::Cursor::Cursor(const std::shared_ptr<const Instance>& instance)
+    : instance_{ instance }
+    , pieceChars_{ instance->__pieceChars() }
+{
+    // 游标只读共享棋谱，无法自行补生成中文着法，须由持有者事先调用updateZhStr
+    if (!instance->zhStrValid_)
+        throw std::logic_error("Cursor: 棋谱中文着法尚未生成，请先调用updateZhStr");
+}
+
+const std::shared_ptr<const Instance> Instance::Cursor::__updated(const std::shared_ptr<Instance>& instance)
+{
+    instance->updateZhStr();
+    return instance;
+}
+
+bool Instance::Cursor::go()
+{
+    auto& next = __move()->next();
+    if (!next)
+        return false;
+    __done(next);
+    return true;
+}
+
+bool Instance::Cursor::back()
+{
+    if (isRoot())
+        return false;
+    __undo();
+    return true;
+}
+
+bool Instance::Cursor::goOther()
+{
+    if (isRoot() || !__move()->other())
+        return false;
+    auto other = __move()->other();
+    __undo();
+    __done(other);
+    return true;
+}
+
+void Instance::Cursor::goInc(int inc)
+{
+    auto fbward = std::mem_fn(inc > 0 ? &Cursor::go : &Cursor::back);
+    for (int i = abs(inc); i != 0; --i)
+        fbward(this);
+}
+
+void Instance::Cursor::backToRoot()
+{
+    while (!isRoot())
+        __undo();
+}
+
+const int Instance::Cursor::frowcol() const { return isRoot() ? -1 : __move()->frowcol(); }
+
+const int Instance::Cursor::trowcol() const { return isRoot() ? -1 : __move()->trowcol(); }
+
+const std::wstring Instance::Cursor::iccs() const { return isRoot() ? L"" : __move()->iccs(); }
+
+const std::wstring Instance::Cursor::zh() const { return __move()->zh(); }
+
+const std::wstring& Instance::Cursor::remark() const { return __move()->remark(); }
+
+const std::shared_ptr<Instance::Move>& Instance::Cursor::__move() const
+{
+    return isRoot() ? instance_->rootMove_ : path_.back().first;
+}
+
+// 只改动游标自身的棋盘字符，不触及棋谱共享的Seat对象
+void Instance::Cursor::__done(const std::shared_ptr<Move>& move)
+{
+    int findex{ SeatManager::getIndex(move->frowcol()) },
+        tindex{ SeatManager::getIndex(move->trowcol()) };
+    path_.push_back({ move, pieceChars_[tindex] });
+    pieceChars_[tindex] = pieceChars_[findex];
+    pieceChars_[findex] = PieceManager::nullChar();
+}
+
+void Instance::Cursor::__undo()
+{
+    auto& move = path_.back().first;
+    int findex{ SeatManager::getIndex(move->frowcol()) },
+        tindex{ SeatManager::getIndex(move->trowcol()) };
+    pieceChars_[findex] = pieceChars_[tindex];
+    pieceChars_[tindex] = path_.back().second;
+    path_.pop_back();
+}
+
 const std::wstring getWString(std::wistream& wis)
 {
     std::wstringstream wss{};
@@ -896,7 +2062,8 @@ const std::wstring getWString(std::wistream& wis)
 
 const std::wstring pieCharsToFEN(const std::wstring& pieceChars)
 {
-    assert(pieceChars.size() == 90);
+    if (pieceChars.size() != 90)
+        throw ParseError("棋子字符串长度不是90");
     std::wstring fen{};
     std::wregex linerg{ LR"(.{9})" };
     for (std::wsregex_token_iterator lineIter{
@@ -940,6 +2107,8 @@ const std::wstring FENTopieChars(const std::wstring& fen)
     }
 
     //assert(fen == pieCharsToFEN(pieceChars));
+    if (pieceChars.size() != 90)
+        throw ParseError("FEN不是90个位置");
     return pieceChars;
 }
 
@@ -952,6 +2121,12 @@ const std::string getExtName(const RecFormat fmt)
         return ".bin";
     case RecFormat::JSON:
         return ".json";
+    case RecFormat::FBIN:
+        return ".fbin";
+    case RecFormat::FJSON:
+        return ".fjson";
+    case RecFormat::CBIN:
+        return ".cbin";
     case RecFormat::PGN_ICCS:
         return ".pgn_iccs";
     case RecFormat::PGN_ZH:
@@ -971,6 +2146,12 @@ RecFormat getRecFormat(const std::string& ext)
         return RecFormat::BIN;
     else if (ext == ".json")
         return RecFormat::JSON;
+    else if (ext == ".fbin")
+        return RecFormat::FBIN;
+    else if (ext == ".fjson")
+        return RecFormat::FJSON;
+    else if (ext == ".cbin")
+        return RecFormat::CBIN;
     else if (ext == ".pgn_iccs")
         return RecFormat::PGN_ICCS;
     else if (ext == ".pgn_zh")
@@ -981,73 +2162,461 @@ RecFormat getRecFormat(const std::string& ext)
         return RecFormat::PGN_CC;
 }
 
-void transDir(const std::string& dirfrom, const RecFormat fmt)
+int transDir(const std::string& dirfrom, const RecFormat fmt, int threadCount, bool continueOnError,
+    const std::string& statsFile, Tools::CopyMode copyMode)
 {
-    int fcount{}, dcount{}, movcount{}, remcount{}, remlenmax{};
-    std::string extensions{ ".xqf.pgn_iccs.pgn_zh.pgn_cc.bin.json" };
+    auto wallStart = std::chrono::steady_clock::now();
+    struct Task {
+        std::string infilename, ext, relname, outname; // relname、outname为相对于源、目标目录的路径
+        long long size, mtime;
+        std::uint64_t hash;
+        bool finished; // 已转换或未变跳过
+    };
+    struct Job {
+        int index;
+        std::string data; // 读取后为源文件内容，生成后为目标文件内容
+        std::shared_ptr<Instance> instance;
+        bool skipped; // 内容未变
+        std::string error; // 解析或生成时的错误
+    };
+    struct Entry {
+        long long size, mtime;
+        std::uint64_t hash;
+        std::string outname;
+    };
+    struct Count {
+        int fcount, movcount, remcount, remlenmax;
+    };
+    int dcount{}, skipcount{}, delcount{};
+    std::vector<std::pair<std::string, std::string>> quarantine{}; // 出错的文件及原因
+    const std::set<std::string> extensions{ ".xqf", ".pgn_iccs", ".pgn_zh", ".pgn_cc", ".bin", ".json", ".fbin", ".fjson", ".cbin" };
     std::string dirto{ dirfrom.substr(0, dirfrom.rfind('.')) + getExtName(fmt) };
-    std::function<void(const std::string&, const std::string&)>
-        __trans = [&](const std::string& dirfrom, const std::string& dirto) {
-            long hFile = 0; //文件句柄
-            struct _finddata_t fileinfo; //文件信息
-            if (access(dirto.c_str(), 0) != 0)
-                mkdir(dirto.c_str());
-            if ((hFile = _findfirst((dirfrom + "/*").c_str(), &fileinfo)) != -1) {
-                do {
-                    std::string filename{ fileinfo.name };
-                    if (fileinfo.attrib & _A_SUBDIR) { //如果是目录,迭代之
-                        if (filename != "." && filename != "..") {
-                            dcount += 1;
-                            __trans(dirfrom + "/" + filename, dirto + "/" + filename);
+    auto __isRecord = [&](const Task& task) { return extensions.count(task.ext) != 0; };
+
+    // 清单：目标目录中记录上次转换的每个源文件(相对路径、长度、修改时间、内容散列、输出文件)
+    // 日志：本次转换中每完成一个文件追加一行，格式同清单；正常结束时并入清单后删除
+    // 上次中途被终止时日志仍在，读入后其中的文件与清单中的一样按未变跳过
+    const std::string manifestName{ "transDir.manifest" }, manifestFile{ dirto + "/" + manifestName },
+        quarantineName{ "transDir.quarantine" }, journalName{ "transDir.journal" },
+        journalFile{ dirto + "/" + journalName }, tmpExt{ ".tmp" };
+    std::map<std::string, Entry> manifest{};
+    auto __readEntries = [&](const std::string& fileName) {
+        std::ifstream ifs(fileName);
+        std::string line{};
+        int count{ 0 };
+        while (std::getline(ifs, line)) {
+            std::istringstream iss{ line };
+            std::string relname{}, size{}, mtime{}, hash{}, outname{};
+            if (!std::getline(iss, relname, '\t') || !std::getline(iss, size, '\t') || !std::getline(iss, mtime, '\t')
+                || !std::getline(iss, hash, '\t') || !std::getline(iss, outname))
+                continue;
+            // 被截断或改坏的行(如中途被终止时写了一半)整行跳过，其文件按新文件重新转换
+            char *sizeEnd{}, *mtimeEnd{}, *hashEnd{};
+            errno = 0;
+            Entry entry{ std::strtoll(size.c_str(), &sizeEnd, 10), std::strtoll(mtime.c_str(), &mtimeEnd, 10),
+                std::strtoull(hash.c_str(), &hashEnd, 16), outname };
+            if (errno != 0 || relname.empty() || outname.empty() || size.empty() || mtime.empty() || hash.empty()
+                || *sizeEnd != '\0' || *mtimeEnd != '\0' || *hashEnd != '\0' || entry.size < 0)
+                continue;
+            manifest[relname] = entry;
+            count += 1;
+        }
+        return count;
+    };
+    auto __entryLine = [](const std::string& relname, const Entry& entry) {
+        std::ostringstream oss{};
+        oss << relname << '\t' << entry.size << '\t' << entry.mtime << '\t'
+            << std::hex << entry.hash << std::dec << '\t' << entry.outname;
+        return oss.str();
+    };
+    __readEntries(manifestFile);
+    int resumecount{ __readEntries(journalFile) };
+    auto __isSame = [&](const Task& task, bool byHash) {
+        auto pos = manifest.find(task.relname);
+        long long size{}, mtime{};
+        return (pos != manifest.end() && pos->second.outname == task.outname
+            && (byHash ? pos->second.hash == task.hash
+                       : pos->second.size == task.size && pos->second.mtime == task.mtime)
+            && Tools::getFileStat(dirto + "/" + task.outname, size, mtime));
+    };
+
+    // 先遍历目录、建立目标目录并收集文件
+    std::vector<Task> tasks{};
+    std::function<void(const std::string&, const std::string&, const std::string&)>
+        __walk = [&](const std::string& dirfrom, const std::string& dirto, const std::string& reldir) {
+            std::vector<std::string> files{}, dirs{};
+            Tools::getEntries(dirfrom, files, dirs);
+            Tools::makeDir(dirto);
+            for (auto& filename : files) {
+                if (reldir.empty() && (filename == manifestName || filename == quarantineName
+                                          || filename == journalName)) // 源目录是上次转换的目标目录
+                    continue;
+                Task task{ dirfrom + "/" + filename, Tools::getExt(filename), reldir + filename, "", 0, 0, 0, false };
+                task.outname = reldir + filename.substr(0, filename.rfind('.'))
+                    + (__isRecord(task) ? getExtName(fmt) : task.ext);
+                Tools::getFileStat(task.infilename, task.size, task.mtime);
+                tasks.push_back(task);
+            }
+            for (auto& dirname : dirs) { //如果是目录,迭代之
+                dcount += 1;
+                __walk(dirfrom + "/" + dirname, dirto + "/" + dirname, reldir + dirname + "/");
+            }
+        };
+    __walk(dirfrom, dirto, "");
+
+    // 长度、修改时间均未变的文件不再读取；其余读取后比较散列
+    std::vector<int> indexes{};
+    for (int index = 0; index != static_cast<int>(tasks.size()); ++index)
+        if (__isSame(tasks[index], false)) {
+            tasks[index].hash = manifest[tasks[index].relname].hash;
+            tasks[index].finished = true;
+            skipcount += 1;
+        } else
+            indexes.push_back(index);
+
+    // 流水线：读取(1线程) -> 解析(threadCount线程) -> 生成(threadCount线程) -> 写入(当前线程)
+    // 各级之间以有界队列连接，下一级处理不及时上一级等待；非棋谱文件原样经过各级
+    if (threadCount <= 0)
+        threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const size_t queueSize{ 64 };
+    Tools::BoundedQueue<Job> parseQueue{ queueSize }, serializeQueue{ queueSize }, writeQueue{ queueSize };
+    // 用过的棋谱对象由生成级交还，解析级取出再用；池空时新建，池满时丢弃
+    Tools::BoundedQueue<std::shared_ptr<Instance>> instancePool{ queueSize + 2 * static_cast<size_t>(threadCount) };
+    std::atomic<int> parseWorkers{ threadCount }, serializeWorkers{ threadCount };
+    std::vector<Count> counts(threadCount, Count{ 0, 0, 0, 0 });
+    // 用时统计：读取、建树、着法按源格式，生成、写入按目标格式；每个线程各用一份，结束后合并
+    // 建树为解析总用时减去生成中文着法及统计的用时
+    enum { READ, BUILD, NOTATION, SERIALIZE, WRITE };
+    const std::vector<Tools::PhaseStats::Phase> phases{ { "读取", "read" }, { "建树", "build" },
+        { "着法", "notation" }, { "生成", "serialize" }, { "写入", "write" } };
+    std::vector<Tools::PhaseStats> stats(2 * threadCount + 2, Tools::PhaseStats{ phases });
+    auto __nanos = [](std::chrono::steady_clock::time_point start) {
+        return static_cast<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+                                          .count());
+    };
+
+    // 出错的文件只记入隔离清单，不影响其他文件；continueOnError为false时不再读取后续文件
+    std::atomic<bool> stopped{ false };
+    std::vector<std::thread> threads{};
+    threads.emplace_back([&]() {
+        for (int index : indexes) {
+            if (stopped)
+                break;
+            if (!__isRecord(tasks[index])) { // 非棋谱文件不读入，写入级直接复制
+                parseQueue.push(Job{ index, "", nullptr, false, "" });
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            std::ifstream ifs(tasks[index].infilename, std::ios_base::binary);
+            std::string data{ std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>() };
+            tasks[index].hash = Tools::getHash(data.data(), data.size());
+            stats[0].add(READ, tasks[index].ext, data.size(), __nanos(start));
+            bool skipped{ __isSame(tasks[index], true) };
+            if (skipped)
+                data.clear();
+            parseQueue.push(Job{ index, std::move(data), nullptr, skipped, "" });
+        }
+        parseQueue.close();
+    });
+    for (int workerNo = 0; workerNo != threadCount; ++workerNo)
+        threads.emplace_back([&, workerNo]() {
+            Tools::PhaseStats& stat = stats[1 + workerNo];
+            for (Job job{}; parseQueue.pop(job);) {
+                const Task& task = tasks[job.index];
+                if (!job.skipped && __isRecord(task)) {
+                    auto start = std::chrono::steady_clock::now();
+                    if (!instancePool.tryPop(job.instance))
+                        job.instance = std::make_shared<Instance>();
+                    try {
+                        RecFormat infmt{ getRecFormat(task.ext) };
+                        // 一个文件只生成一个目标文件，多局的PGN文件整体转换会丢失首局之后的棋谱，须用PGNReader逐局转换
+                        if (infmt == RecFormat::PGN_ICCS || infmt == RecFormat::PGN_ZH || infmt == RecFormat::PGN_CC) {
+                            std::wistringstream wis{ Tools::decode(job.data) };
+                            PGNReader reader{ wis, infmt };
+                            if (reader.skip() && reader.skip())
+                                throw ParseError("文件中有多局棋谱，不能整体转换");
                         }
-                    } else { //如果是文件,执行转换
-                        std::string infilename{ dirfrom + "/" + filename };
-                        std::string fileto{ dirto + "/" + filename.substr(0, filename.rfind('.')) };
-                        std::string ext_old{ Tools::getExt(filename) };
-                        if (extensions.find(ext_old) != std::string::npos) {
-                            fcount += 1;
-
-                            //std::cout << infilename << std::endl;
-                            Instance ci(infilename);
-                            //std::cout << infilename << " read finished!" << std::endl;
-                            //std::cout << fileto << std::endl;
-                            ci.write(fileto + getExtName(fmt));
-                            //std::cout << fileto + getExtName(fmt) << " write finished!" << std::endl;
-
-                            movcount += ci.getMovCount();
-                            remcount += ci.getRemCount();
-                            remlenmax = std::max(remlenmax, ci.getRemLenMax());
-                        } else
-                            Tools::copyFile(infilename.c_str(), (fileto + ext_old).c_str());
+                        job.instance->read(job.data.data(), job.data.size(), infmt);
+                        long long notationNanos{ job.instance->getNotationNanos() };
+                        stat.add(BUILD, task.ext, job.data.size(), __nanos(start) - notationNanos);
+                        stat.add(NOTATION, task.ext, job.data.size(), notationNanos);
+                    } catch (const std::exception& e) {
+                        job.error = e.what();
+                        instancePool.tryPush(std::move(job.instance));
+                        job.instance.reset();
                     }
-                } while (_findnext(hFile, &fileinfo) == 0);
-                _findclose(hFile);
+                    job.data.clear();
+                }
+                serializeQueue.push(std::move(job));
             }
-        };
+            if (--parseWorkers == 0) // 最后结束的线程关闭下一级队列
+                serializeQueue.close();
+        });
+    for (int workerNo = 0; workerNo != threadCount; ++workerNo)
+        threads.emplace_back([&, workerNo]() {
+            Tools::PhaseStats& stat = stats[1 + threadCount + workerNo];
+            for (Job job{}; serializeQueue.pop(job);) {
+                if (job.instance) {
+                    auto start = std::chrono::steady_clock::now();
+                    std::ostringstream os{};
+                    try {
+                        job.instance->write(os, fmt);
+                    } catch (const std::exception& e) {
+                        job.error = e.what();
+                        instancePool.tryPush(std::move(job.instance));
+                        job.instance.reset();
+                        writeQueue.push(std::move(job));
+                        continue;
+                    }
+                    job.data = os.str();
+                    stat.add(SERIALIZE, getExtName(fmt), job.data.size(), __nanos(start));
+
+                    Count& count = counts[workerNo];
+                    count.fcount += 1;
+                    count.movcount += job.instance->getMovCount();
+                    count.remcount += job.instance->getRemCount();
+                    count.remlenmax = std::max(count.remlenmax, job.instance->getRemLenMax());
+                    instancePool.tryPush(std::move(job.instance));
+                    job.instance.reset();
+                }
+                writeQueue.push(std::move(job));
+            }
+            if (--serializeWorkers == 0)
+                writeQueue.close();
+        });
+    // 先写临时文件再改名替换，中途终止时目标目录中不会有不完整的文件
+    Tools::Journal journal{ journalFile };
+    for (Job job{}; writeQueue.pop(job);) {
+        Task& task = tasks[job.index];
+        if (!job.error.empty()) {
+            quarantine.push_back(std::make_pair(task.relname, job.error));
+            if (!continueOnError)
+                stopped = true;
+            continue;
+        }
+        if (job.skipped) {
+            skipcount += 1;
+        } else {
+            auto start = std::chrono::steady_clock::now();
+            bool isRecord{ __isRecord(task) };
+            std::string outfilename{ dirto + "/" + task.outname }, tmpfilename{ outfilename + tmpExt };
+            bool written{};
+            if (isRecord) { // PGN格式以文本方式写出，同宽字符文件流
+                std::ofstream ofs(tmpfilename,
+                    (fmt == RecFormat::PGN_ICCS || fmt == RecFormat::PGN_ZH || fmt == RecFormat::PGN_CC)
+                        ? std::ios_base::out
+                        : std::ios_base::binary);
+                written = static_cast<bool>(ofs.write(job.data.data(), job.data.size()).flush());
+            } else
+                written = Tools::copyFile(task.infilename, tmpfilename, copyMode);
+            if (!written || !Tools::renameFile(tmpfilename, outfilename)) {
+                std::remove(tmpfilename.c_str());
+                quarantine.push_back(std::make_pair(task.relname, std::string(isRecord ? "写入文件失败" : "复制文件失败")));
+                if (!continueOnError)
+                    stopped = true;
+                continue;
+            }
+            stats.back().add(WRITE, isRecord ? getExtName(fmt) : task.ext,
+                isRecord ? static_cast<long long>(job.data.size()) : task.size, __nanos(start));
+        }
+        task.finished = true;
+        journal.append(__entryLine(task.relname, Entry{ task.size, task.mtime, task.hash, task.outname }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    // 删除已不存在或出错的源文件的旧输出，再写出新清单；中止时未处理的文件保留原记录
+    std::map<std::string, Entry> newManifest{};
+    for (auto& task : tasks)
+        if (task.finished)
+            newManifest[task.relname] = Entry{ task.size, task.mtime, task.hash, task.outname };
+        else if (manifest.find(task.relname) != manifest.end())
+            newManifest[task.relname] = manifest[task.relname];
+    for (auto& relError : quarantine)
+        newManifest.erase(relError.first);
+    // 不同源文件可能输出到同一文件(如改了扩展名的源文件)，仍在用的输出文件不删
+    std::set<std::string> outnames{};
+    for (auto& kv : newManifest)
+        outnames.insert(kv.second.outname);
+    for (auto& kv : manifest)
+        if (newManifest.find(kv.first) == newManifest.end() && outnames.find(kv.second.outname) == outnames.end()) {
+            std::remove((dirto + "/" + kv.second.outname).c_str());
+            delcount += 1;
+        }
+    {
+        std::ofstream ofs(manifestFile + tmpExt);
+        for (auto& kv : newManifest)
+            ofs << __entryLine(kv.first, kv.second) << '\n';
+    }
+    // 清单替换成功后日志才可删除
+    journal.close();
+    if (Tools::renameFile(manifestFile + tmpExt, manifestFile))
+        std::remove(journalFile.c_str());
+    {
+        std::ofstream ofs(dirto + "/" + quarantineName);
+        for (auto& relError : quarantine)
+            ofs << relError.first << '\t' << relError.second << '\n';
+    }
 
-    __trans(dirfrom, dirto);
-    std::cout << dirfrom + " =>" << getExtName(fmt) << ": 转换" << fcount << "个文件, "
-              << dcount << "个目录成功！\n   着法数量: "
-              << movcount << ", 注释数量: " << remcount << ", 最大注释长度: " << remlenmax << std::endl;
+    Count total{ 0, 0, 0, 0 };
+    for (auto& count : counts) {
+        total.fcount += count.fcount;
+        total.movcount += count.movcount;
+        total.remcount += count.remcount;
+        total.remlenmax = std::max(total.remlenmax, count.remlenmax);
+    }
+    std::cout << dirfrom + " =>" << getExtName(fmt) << ": 转换" << total.fcount << "个文件(未变跳过"
+              << skipcount << "个" << (resumecount > 0 ? ", 含日志恢复" + std::to_string(resumecount) + "个" : "")
+              << ", 删除" << delcount << "个, 出错隔离" << quarantine.size() << "个), "
+              << dcount << "个目录" << (stopped ? "，因出错中止！" : "成功！") << "\n   着法数量: "
+              << total.movcount << ", 注释数量: " << total.remcount << ", 最大注释长度: " << total.remlenmax << std::endl;
+    for (int index = 1; index != static_cast<int>(stats.size()); ++index)
+        stats[0].merge(stats[index]);
+    long long wallNanos{ __nanos(wallStart) };
+    stats[0].print(std::cout, wallNanos);
+    if (!statsFile.empty()) {
+        std::ofstream ofs(statsFile);
+        stats[0].writeJSON(ofs, wallNanos);
+    }
+    return static_cast<int>(quarantine.size());
 }
 
-void testTransDir(int fd, int td, int ff, int ft, int tf, int tt)
+void testTransDir(const std::vector<std::string>& dirfroms, int fd, int td, int ff, int ft, int tf, int tt,
+    int threadCount, bool continueOnError)
 {
-    std::vector<std::string> dirfroms{
-        "c:\\棋谱\\示例文件",
-        "c:\\棋谱\\象棋杀着大全",
-        "c:\\棋谱\\疑难文件",
-        "c:\\棋谱\\中国象棋棋谱大全"
-    };
     std::vector<RecFormat> fmts{
         RecFormat::XQF, RecFormat::BIN, RecFormat::JSON,
-        RecFormat::PGN_ICCS, RecFormat::PGN_ZH, RecFormat::PGN_CC
+        RecFormat::PGN_ICCS, RecFormat::PGN_ZH, RecFormat::PGN_CC, RecFormat::FBIN, RecFormat::FJSON, RecFormat::CBIN
     };
     // 调节三个循环变量的初值、终值，控制转换目录
     for (int dir = fd; dir != td; ++dir)
         for (int fIndex = ff; fIndex != ft; ++fIndex)
             for (int tIndex = tf; tIndex != tt; ++tIndex)
                 if (tIndex > 0 && tIndex != fIndex)
-                    transDir(dirfroms[dir] + getExtName(fmts[fIndex]), fmts[tIndex]);
+                    transDir(dirfroms.at(dir) + getExtName(fmts[fIndex]), fmts[tIndex], threadCount, continueOnError);
+}
+
+int verifyDir(const std::string& dirfrom, int threadCount, const std::string& reportFile)
+{
+    const std::vector<RecFormat> fmts{
+        RecFormat::XQF, RecFormat::BIN, RecFormat::JSON,
+        RecFormat::PGN_ICCS, RecFormat::PGN_ZH, RecFormat::PGN_CC, RecFormat::FBIN, RecFormat::FJSON, RecFormat::CBIN
+    };
+    const int fmtCount = fmts.size();
+    const std::set<std::string> extensions{ ".xqf", ".pgn_iccs", ".pgn_zh", ".pgn_cc", ".bin", ".json", ".fbin", ".fjson", ".cbin" };
+    std::vector<std::string> filenames{};
+    std::function<void(const std::string&)>
+        __walk = [&](const std::string& dirname) {
+            std::vector<std::string> files{}, dirs{};
+            Tools::getEntries(dirname, files, dirs);
+            for (auto& filename : files) {
+                std::string ext{ Tools::getExt(filename) };
+                if (extensions.count(ext))
+                    filenames.push_back(dirname + "/" + filename);
+            }
+            for (auto& subdir : dirs)
+                __walk(dirname + "/" + subdir);
+        };
+    __walk(dirfrom);
+    std::sort(filenames.begin(), filenames.end());
+
+    // 写出到内存再读回，出错时抛出异常
+    auto __convert = [](Instance& from, RecFormat fmt, Instance& to) {
+        std::ostringstream os{};
+        from.write(os, fmt);
+        std::string data{ os.str() };
+        to.read(data.data(), data.size(), fmt);
+    };
+    // 第一处不同的行：行号及原文、转换后的文本
+    auto __diff = [](const std::wstring& expected, const std::wstring& actual) {
+        std::wistringstream wisExpected{ expected }, wisActual{ actual };
+        std::wstring lineExpected{}, lineActual{};
+        for (int lineNo = 1;; ++lineNo) {
+            bool hasExpected{ static_cast<bool>(std::getline(wisExpected, lineExpected)) },
+                hasActual{ static_cast<bool>(std::getline(wisActual, lineActual)) };
+            if (!hasExpected && !hasActual)
+                return std::string{};
+            if (!hasExpected || !hasActual || lineExpected != lineActual)
+                return "第" + std::to_string(lineNo) + "行: 原为\"" + (hasExpected ? Tools::ws2s(lineExpected) : "")
+                    + "\" 现为\"" + (hasActual ? Tools::ws2s(lineActual) : "") + "\"";
+        }
+    };
+
+    // 每个文件：原棋谱先写出为格式f再读回，然后写出为格式t再读回，与原棋谱比较
+    struct Result {
+        int failCount; // 不符的格式对数，-1为原文件读取出错
+        std::string divergence;
+    };
+    if (threadCount <= 0)
+        threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    std::vector<Result> results(filenames.size(), Result{ 0, "" });
+    std::vector<std::vector<int>> failCounts(threadCount, std::vector<int>(fmtCount * fmtCount, 0));
+    Tools::parallelFor(filenames.size(), threadCount, [&](int index, int workerNo) {
+        Result& result = results[index];
+        Instance source{};
+        try {
+            source.read(filenames[index]);
+        } catch (const std::exception& e) {
+            result = Result{ -1, std::string("读取出错: ") + e.what() };
+            return;
+        }
+        for (int fIndex = 0; fIndex != fmtCount; ++fIndex) {
+            Instance middle{};
+            std::string error{};
+            try {
+                __convert(source, fmts[fIndex], middle);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            for (int tIndex = 0; tIndex != fmtCount; ++tIndex) {
+                std::string divergence{ error };
+                if (divergence.empty())
+                    try {
+                        Instance target{};
+                        __convert(middle, fmts[tIndex], target);
+                        divergence = __diff(source.getCanonical({ fmts[fIndex], fmts[tIndex] }), target.getCanonical());
+                    } catch (const std::exception& e) {
+                        divergence = e.what();
+                    }
+                if (divergence.empty())
+                    continue;
+                failCounts[workerNo][fIndex * fmtCount + tIndex] += 1;
+                if (result.failCount++ == 0)
+                    result.divergence = getExtName(fmts[fIndex]) + "=>" + getExtName(fmts[tIndex]) + " " + divergence;
+            }
+        }
+    });
+
+    std::vector<int> total(fmtCount * fmtCount, 0);
+    for (auto& counts : failCounts)
+        for (int index = 0; index != fmtCount * fmtCount; ++index)
+            total[index] += counts[index];
+    int failFiles{}, errorFiles{};
+    std::ofstream ofs{};
+    if (!reportFile.empty())
+        ofs.open(reportFile);
+    std::ostream& report = reportFile.empty() ? std::cout : ofs;
+    for (int index = 0; index != static_cast<int>(filenames.size()); ++index) {
+        const Result& result = results[index];
+        if (result.failCount == 0)
+            continue;
+        (result.failCount < 0 ? errorFiles : failFiles) += 1;
+        report << filenames[index] << '\t' << (result.failCount < 0 ? 0 : result.failCount) << '\t'
+               << result.divergence << '\n';
+    }
+    std::cout << dirfrom << ": 校验" << filenames.size() << "个文件, 不符" << failFiles << "个, 读取出错"
+              << errorFiles << "个\n   各格式对的不符文件数(行为先写出的格式, 列为再写出的格式):\n" << std::string(12, ' ');
+    for (auto fmt : fmts)
+        std::cout << std::setw(10) << getExtName(fmt);
+    std::cout << '\n';
+    for (int fIndex = 0; fIndex != fmtCount; ++fIndex) {
+        std::cout << "   " << std::left << std::setw(9) << getExtName(fmts[fIndex]) << std::right;
+        for (int tIndex = 0; tIndex != fmtCount; ++tIndex)
+            std::cout << std::setw(10) << total[fIndex * fmtCount + tIndex];
+        std::cout << '\n';
+    }
+    std::cout << std::flush;
+    return failFiles + errorFiles;
 }
 }
\ No newline at end of file
@@ -1,11 +1,246 @@
 #include "board.h"
+#include "cbinfile.h"
 #include "instance.h"
+#include "pgnfile.h"
 #include "tools.h"
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <fstream>
 #include <iostream>
 #include <locale>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#ifdef _WIN32
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <io.h>
+#endif
 //#define NDEBUG
 
+using namespace InstanceSpace;
+
+namespace {
+
+const char* usage{
+    "用法:\n"
+    "  a.exe [选项] 输入文件 [输出文件]   转换一个棋谱文件，输入、输出为-时使用标准输入、输出\n"
+    "  a.exe [选项] 输入目录             转换整个目录至同级的\"目录名.格式\"目录\n"
+    "  a.exe --verify 输入目录 [报告文件] 校验目录下的棋谱经各格式转换后不变\n"
+    "  a.exe --test [目录...] [fd td ff ft tf tt]\n"
+    "                                    运行原有的测试及目录转换；目录不带格式扩展名，须有\"目录.xqf\"，\n"
+    "                                    缺省时以当前目录下的示例棋谱01.XQF、4.XQF建立\"示例文件.xqf\"\n"
+    "选项:\n"
+    "  -f, --from 格式    输入格式，不按扩展名确定；标准输入时必须指定\n"
+    "  -t, --to 格式      输出格式，不按扩展名确定；目录、标准输出时必须指定\n"
+    "                     格式: xqf pgn_iccs pgn_zh pgn_cc bin json fbin fjson cbin\n"
+    "  -j, --threads N    目录转换的线程数，默认为CPU核数\n"
+    "  --stop-on-error    遇到出错的文件(或流中出错的一局)即中止，默认略过并继续\n"
+    "  --stats 文件       目录转换的分阶段用时统计另存为JSON文件\n"
+    "  --copy 方式        目录中非棋谱文件的复制方式: stream kernel(默认) reflink hardlink\n"
+    "  -h, --help         显示本说明\n"
+    "PGN格式的输入可含多局，逐局读取转换；输出为PGN或cbin格式时可保存多局，其余格式只能保存一局\n"
+    "目录转换时每个文件各生成一个目标文件(cbin也只含一局)，含多局的PGN文件按出错隔离\n"
+    "退出码: 0成功，1参数有误或无法打开文件，2有出错的棋谱(流中的一局、目录中隔离的文件或校验不符的文件)\n"
+};
+
+const bool isPGN(RecFormat fmt)
+{
+    return fmt == RecFormat::PGN_ICCS || fmt == RecFormat::PGN_ZH || fmt == RecFormat::PGN_CC;
+}
+
+// 格式名即扩展名，可不带"."、不区分大小写；getRecFormat对未知扩展名返回PGN_CC，此处须严格匹配
+bool getFormat(const std::string& name, RecFormat& fmt)
+{
+    std::string ext{ !name.empty() && name[0] == '.' ? name : "." + name };
+    for (auto& ch : ext)
+        ch = std::tolower(ch);
+    for (auto recFmt : { RecFormat::XQF, RecFormat::PGN_ICCS, RecFormat::PGN_ZH, RecFormat::PGN_CC,
+             RecFormat::BIN, RecFormat::JSON, RecFormat::FBIN, RecFormat::FJSON, RecFormat::CBIN })
+        if (getExtName(recFmt) == ext) {
+            fmt = recFmt;
+            return true;
+        }
+    return false;
+}
+
+bool isDirectory(const std::string& path)
+{
+    struct stat st {};
+    return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+// 输出将覆盖输入时须拒绝：打开输出即截断了尚未读取的输入
+bool isSameFile(const std::string& path1, const std::string& path2)
+{
+#ifdef _WIN32
+    // MinGW的stat不给出文件号，比较不区分大小写的完整路径
+    char full1[_MAX_PATH], full2[_MAX_PATH];
+    if (!_fullpath(full1, path1.c_str(), _MAX_PATH) || !_fullpath(full2, path2.c_str(), _MAX_PATH))
+        return false;
+    return _stricmp(full1, full2) == 0;
+#else
+    // 同一设备上的同一文件号，包括链接及不区分大小写的文件系统上仅大小写不同的路径
+    struct stat st1 {}, st2 {};
+    return stat(path1.c_str(), &st1) == 0 && stat(path2.c_str(), &st2) == 0
+        && st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+#endif
+}
+
+// 转换一个棋谱流：PGN逐局读取，不在内存中保存整个输入；其余格式整体读入
+// 返回0成功，2有出错的棋谱(continueOnError时其余各局仍已转换)
+int convertStream(std::istream& is, RecFormat fromFmt, std::ostream& os, RecFormat toFmt, bool continueOnError)
+{
+    // 按行读入并按locale解码，同Instance::read(data, size, fmt)对PGN文本的处理
+    class LineBuf : public std::wstreambuf {
+    public:
+        explicit LineBuf(std::istream& is)
+            : is_(is)
+        {
+        }
+
+    protected:
+        int_type underflow() override
+        {
+            std::string line{};
+            if (!std::getline(is_, line))
+                return traits_type::eof();
+#ifdef _WIN32
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+#endif
+            line_ = Tools::decode(line);
+            if (!is_.eof())
+                line_.push_back(L'\n');
+            if (line_.empty())
+                return traits_type::eof();
+            setg(&line_[0], &line_[0], &line_[0] + line_.size());
+            return traits_type::to_int_type(line_[0]);
+        }
+
+    private:
+        std::istream& is_;
+        std::wstring line_{};
+    };
+
+    std::unique_ptr<Instance::CBinWriter> cbinWriter{ toFmt == RecFormat::CBIN ? new Instance::CBinWriter(os) : nullptr };
+    int gameNo{ 0 }, gameCount{ 0 }, errorCount{ 0 };
+    auto __error = [&](const std::string& reason) {
+        std::cerr << "第" << gameNo + 1 << "局出错: " << reason << std::endl;
+        errorCount += 1;
+        return continueOnError;
+    };
+    // 写出一局，PGN格式各局之间以空行分隔
+    auto __write = [&](Instance& instance) {
+        if (!cbinWriter && !isPGN(toFmt) && gameCount > 0) {
+            __error("输出格式" + getExtName(toFmt) + "只能保存一局，其余各局未转换");
+            return false;
+        }
+        try {
+            if (cbinWriter)
+                cbinWriter->write(instance);
+            else {
+                if (gameCount > 0)
+                    os << "\n\n";
+                instance.write(os, toFmt);
+            }
+        } catch (const std::exception& e) {
+            return __error(e.what());
+        }
+        gameCount += 1;
+        return true;
+    };
+
+    Instance instance{};
+    if (isPGN(fromFmt)) {
+        LineBuf lineBuf{ is };
+        std::wistream wis{ &lineBuf };
+        PGNReader reader{ wis, fromFmt };
+        for (;; ++gameNo) {
+            try {
+                if (!reader.next(instance))
+                    break;
+            } catch (const std::exception& e) {
+                if (!__error(e.what()))
+                    break;
+                continue;
+            }
+            if (!__write(instance))
+                break;
+        }
+    } else {
+        std::string data{ std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+        try {
+            if (fromFmt == RecFormat::CBIN) {
+                Instance::CBinReader reader{ data.data(), data.size() };
+                for (; gameNo != reader.getGameCount(); ++gameNo) {
+                    try {
+                        reader.toInstance(gameNo, instance);
+                    } catch (const std::exception& e) {
+                        if (!__error(e.what()))
+                            break;
+                        continue;
+                    }
+                    if (!__write(instance))
+                        break;
+                }
+            } else {
+                instance.read(data.data(), data.size(), fromFmt);
+                __write(instance);
+            }
+        } catch (const std::exception& e) {
+            __error(e.what());
+        }
+    }
+    if (cbinWriter)
+        cbinWriter->close();
+    os.flush();
+    std::cerr << "转换" << gameCount << "局" << (errorCount > 0 ? ", 出错" + std::to_string(errorCount) + "局" : "")
+              << std::endl;
+    return errorCount > 0 ? 2 : 0;
+}
+
+void runTest(const std::vector<std::string>& args)
+{
+    BoardSpace::Board board{};
+    Tools::writeTxt("board.txt", board.test());
+    Instance ci{};
+    Tools::writeTxt("instance.txt", ci.test());
+
+    // 末尾6个均为数字时是循环范围，其余为目录
+    auto __isNum = [](const std::string& arg) {
+        return !arg.empty() && std::all_of(arg.begin(), arg.end(), [](char ch) { return std::isdigit(ch); });
+    };
+    bool hasRange{ args.size() >= 6 && std::all_of(args.end() - 6, args.end(), __isNum) };
+    std::vector<std::string> dirfroms{ args.begin(), hasRange ? args.end() - 6 : args.end() };
+    if (dirfroms.empty()) { // 以源码目录中的示例棋谱建立示例目录
+        const std::string dirfrom{ "示例文件" };
+        Tools::makeDir(dirfrom + ".xqf");
+        for (auto& filename : { "01.XQF", "4.XQF" })
+            Tools::copyFile(filename, dirfrom + ".xqf/" + filename, Tools::CopyMode::STREAM);
+        dirfroms.push_back(dirfrom);
+    }
+    int dirCount = dirfroms.size();
+    if (hasRange) {
+        auto range = args.end() - 6;
+        testTransDir(dirfroms, std::stoi(range[0]), std::stoi(range[1]),
+            std::stoi(range[2]), std::stoi(range[3]), std::stoi(range[4]), std::stoi(range[5]));
+    } else {
+        //testTransDir(dirfroms, 0, dirCount, 0, 6, 1, 6);
+        //std::cout << "------------------------------------------------------------------" << std::endl;
+        testTransDir(dirfroms, 0, dirCount, 0, 1, 1, 6);
+        testTransDir(dirfroms, 0, dirCount, 1, 5, 5, 6);
+        testTransDir(dirfroms, 0, dirCount, 5, 6, 1, 2);
+        //std::cout << "------------------------------------------------------------------" << std::endl;
+        //testTransDir(dirfroms, 0, dirCount, 2, 3, 1, 5);
+    }
+}
+}
+
 int main(int argc, char const* argv[])
 {
     using namespace std::chrono;
@@ -13,31 +248,137 @@ int main(int argc, char const* argv[])
     setlocale(LC_ALL, "");
     std::ios_base::sync_with_stdio(false);
 
+    RecFormat fromFmt{}, toFmt{};
+    bool hasFrom{ false }, hasTo{ false }, continueOnError{ true }, verify{ false }, test{ false };
+    int threadCount{ 0 };
+    std::string statsFile{};
+    Tools::CopyMode copyMode{ Tools::CopyMode::KERNEL };
+    std::vector<std::string> paths{};
+    for (int index = 1; index < argc; ++index) {
+        std::string arg{ argv[index] };
+        auto __value = [&]() {
+            if (index + 1 == argc)
+                throw std::invalid_argument(arg + "缺少参数值");
+            return std::string{ argv[++index] };
+        };
+        try {
+            if (arg == "-f" || arg == "--from") {
+                if (!(hasFrom = getFormat(__value(), fromFmt)))
+                    throw std::invalid_argument("未知的输入格式: " + std::string{ argv[index] });
+            } else if (arg == "-t" || arg == "--to") {
+                if (!(hasTo = getFormat(__value(), toFmt)))
+                    throw std::invalid_argument("未知的输出格式: " + std::string{ argv[index] });
+            } else if (arg == "-j" || arg == "--threads")
+                threadCount = std::stoi(__value());
+            else if (arg == "--stop-on-error")
+                continueOnError = false;
+            else if (arg == "--stats")
+                statsFile = __value();
+            else if (arg == "--copy") {
+                std::string mode{ __value() };
+                if (mode == "stream")
+                    copyMode = Tools::CopyMode::STREAM;
+                else if (mode == "kernel")
+                    copyMode = Tools::CopyMode::KERNEL;
+                else if (mode == "reflink")
+                    copyMode = Tools::CopyMode::REFLINK;
+                else if (mode == "hardlink")
+                    copyMode = Tools::CopyMode::HARDLINK;
+                else
+                    throw std::invalid_argument("未知的复制方式: " + mode);
+            } else if (arg == "--verify")
+                verify = true;
+            else if (arg == "--test")
+                test = true;
+            else if (arg == "-h" || arg == "--help") {
+                std::cout << usage;
+                return 0;
+            } else if (arg.size() > 1 && arg[0] == '-' && !test)
+                throw std::invalid_argument("未知的选项: " + arg);
+            else
+                paths.push_back(arg);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n"
+                      << usage;
+            return 1;
+        }
+    }
+
     auto time0 = steady_clock::now();
-    //*
-    BoardSpace::Board board{};
-    Tools::writeTxt("board.txt", board.test());
-    InstanceSpace::Instance ci{};
-    Tools::writeTxt("instance.txt", ci.test());
-    //*/
-    //*
-    if (argc == 7)
-        InstanceSpace::testTransDir(std::stoi(argv[1]), std::stoi(argv[2]),
-            std::stoi(argv[3]), std::stoi(argv[4]), std::stoi(argv[5]), std::stoi(argv[6]));
-    else {
-        //InstanceSpace::testTransDir(0, 2, 0, 6, 1, 6);
-        //std::cout << "------------------------------------------------------------------" << std::endl;
-        InstanceSpace::testTransDir(0, 2, 0, 1, 1, 6);
-        InstanceSpace::testTransDir(0, 2, 1, 5, 5, 6);
-        InstanceSpace::testTransDir(0, 2, 5, 6, 1, 2);
-        //std::cout << "------------------------------------------------------------------" << std::endl;
-        //InstanceSpace::testTransDir(0, 2, 2, 3, 1, 5);
+    auto __useTime = [&]() {
+        std::cout << "use time: " << duration_cast<milliseconds>(steady_clock::now() - time0).count() / 1000.0 << "s\n";
+    };
+    if (test) {
+        runTest(paths);
+        __useTime();
+        return 0;
+    }
+    if (paths.empty() && hasFrom && !verify) // 只指定格式时为标准输入至标准输出
+        paths.push_back("-");
+    if (paths.empty() || paths.size() > 2) {
+        std::cerr << usage;
+        return 1;
+    }
+    const std::string& input{ paths[0] };
+    if (verify) {
+        int failCount{ verifyDir(input, threadCount, paths.size() == 2 ? paths[1] : "") };
+        __useTime();
+        return failCount > 0 ? 2 : 0;
+    }
+    if (input != "-" && isDirectory(input)) {
+        if (!hasTo || paths.size() == 2) {
+            std::cerr << "目录转换须以-t指定输出格式，输出目录由输入目录名确定\n";
+            return 1;
+        }
+        int quarantineCount{ transDir(input, toFmt, threadCount, continueOnError, statsFile, copyMode) };
+        __useTime();
+        return quarantineCount > 0 ? 2 : 0;
     }
-    //*/
 
-    auto time_d = steady_clock::now() - time0;
-    std::cout << "use time: " << duration_cast<milliseconds>(time_d).count() / 1000.0 << "s\n";
+    // 单个文件或流：未指定格式时按扩展名确定，未指定输出时与输入同名或为标准输出
+    std::string output{ paths.size() == 2 ? paths[1] : "-" };
+    if (!hasFrom && (input == "-" || !getFormat(Tools::getExt(input), fromFmt))) {
+        std::cerr << "无法确定输入格式，请以-f指定\n";
+        return 1;
+    }
+    if (!hasTo && (output == "-" || !getFormat(Tools::getExt(output), toFmt))) {
+        std::cerr << "无法确定输出格式，请以-t指定\n";
+        return 1;
+    }
+    if (paths.size() == 1 && input != "-") { // 只去掉文件名的扩展名，目录名中的'.'保留
+        std::string ext{ Tools::getExt(input) };
+        output = input.substr(0, input.size() - ext.size()) + getExtName(toFmt);
+    }
+    if (input != "-" && output != "-" && isSameFile(input, output)) {
+        std::cerr << "输出文件与输入文件相同: " << output << "\n";
+        return 1;
+    }
 
-    //std::locale::global(loc);
-    return 0;
+    // PGN为文本，同宽字符文件流按文本方式读写；其余格式按二进制方式
+    std::ifstream ifs{};
+    if (input != "-") {
+        ifs.open(input, isPGN(fromFmt) ? std::ios_base::in : std::ios_base::in | std::ios_base::binary);
+        if (!ifs) {
+            std::cerr << "无法打开输入文件: " << input << "\n";
+            return 1;
+        }
+    }
+#ifdef _WIN32
+    else if (!isPGN(fromFmt))
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    std::ofstream ofs{};
+    if (output != "-") {
+        ofs.open(output, isPGN(toFmt) ? std::ios_base::out : std::ios_base::out | std::ios_base::binary);
+        if (!ofs) {
+            std::cerr << "无法创建输出文件: " << output << "\n";
+            return 1;
+        }
+    }
+#ifdef _WIN32
+    else if (!isPGN(toFmt))
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    return convertStream(input == "-" ? std::cin : ifs, fromFmt, output == "-" ? std::cout : ofs,
+        toFmt, continueOnError);
 }
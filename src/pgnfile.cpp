@@ -0,0 +1,162 @@
+#include "pgnfile.h"
+#include "tools.h"
+#include <sstream>
+
+namespace InstanceSpace {
+
+static RecFormat checkPGNFormat(RecFormat fmt)
+{
+    if (fmt != RecFormat::PGN_ICCS && fmt != RecFormat::PGN_ZH && fmt != RecFormat::PGN_CC)
+        throw ParseError("不是PGN格式: " + getExtName(fmt));
+    return fmt;
+}
+
+// 文件名的扩展名须为PGN格式之一(getRecFormat对未知扩展名返回PGN_CC，故须比较扩展名)
+static RecFormat getPGNFormat(const std::string& fileName)
+{
+    RecFormat fmt{ getRecFormat(Tools::getExt(fileName)) };
+    if (getExtName(fmt) != Tools::getExt(fileName))
+        throw ParseError("不是PGN格式的棋谱文件: " + fileName);
+    return checkPGNFormat(fmt);
+}
+
+PGNReader::PGNReader(const std::string& fileName)
+    : fmt_{ getPGNFormat(fileName) }
+    , file_{ fileName }
+    , wis_(file_)
+{
+}
+
+PGNReader::PGNReader(std::wistream& wis, RecFormat fmt)
+    : fmt_{ checkPGNFormat(fmt) }
+    , wis_(wis)
+{
+}
+
+bool PGNReader::next(Instance& instance)
+{
+    std::wstring text{};
+    if (!__readGame(&text))
+        return false;
+    std::wistringstream wiss{ text };
+    instance.read(wiss, fmt_);
+    ++gameNo_;
+    return true;
+}
+
+bool PGNReader::skip()
+{
+    if (!__readGame(nullptr))
+        return false;
+    ++gameNo_;
+    return true;
+}
+
+bool PGNReader::seek(int gameNo)
+{
+    auto& index = getIndex();
+    if (gameNo < 0 || gameNo >= static_cast<int>(index.size()))
+        return false;
+    wis_.clear();
+    wis_.seekg(index[gameNo]);
+    hasPending_ = false;
+    gameNo_ = gameNo;
+    return true;
+}
+
+const std::vector<std::streampos>& PGNReader::getIndex()
+{
+    if (hasIndex_)
+        return index_;
+    // 从头扫描一遍，只记录各局起点，不缓存文本
+    wis_.clear();
+    wis_.seekg(0);
+    hasPending_ = false;
+    recordPos_ = true;
+    while (__readGame(nullptr))
+        index_.push_back(gamePos_);
+    recordPos_ = false;
+    hasIndex_ = true;
+
+    // 恢复至扫描前的局序号
+    wis_.clear();
+    if (gameNo_ < static_cast<int>(index_.size()))
+        wis_.seekg(index_[gameNo_]);
+    else
+        wis_.seekg(0, std::ios_base::end);
+    return index_;
+}
+
+PGNReader::LineType PGNReader::__getLineType(const std::wstring& line) const
+{
+    auto pos = line.find_first_not_of(L" \t\r");
+    if (pos == std::wstring::npos)
+        return LineType::BLANK;
+    return line[pos] == L'[' ? LineType::INFO : LineType::OTHER;
+}
+
+bool PGNReader::__getLine(std::wstring& line)
+{
+    if (hasPending_) {
+        line = pendingLine_;
+        linePos_ = pendingPos_;
+        hasPending_ = false;
+        return true;
+    }
+    if (recordPos_)
+        linePos_ = wis_.tellg();
+    return static_cast<bool>(std::getline(wis_, line));
+}
+
+bool PGNReader::__readGame(std::wstring* text)
+{
+    std::wstring line{};
+    // 略过局间的空行
+    do
+        if (!__getLine(line))
+            return false;
+    while (__getLineType(line) == LineType::BLANK);
+    gamePos_ = linePos_;
+
+    bool inMoves{ false };
+    int remarkDepth{ 0 };
+    do {
+        LineType lineType{ __getLineType(line) };
+        if (!inMoves) {
+            if (lineType == LineType::BLANK)
+                inMoves = true; // 信息区以空行为终止特征
+        } else if (remarkDepth == 0 && lineType == LineType::INFO) {
+            pendingLine_ = line;
+            pendingPos_ = linePos_;
+            hasPending_ = true;
+            break;
+        } else
+            for (auto ch : line)
+                if (ch == L'{')
+                    ++remarkDepth;
+                else if (ch == L'}' && remarkDepth > 0)
+                    --remarkDepth;
+        if (text) {
+            text->append(line);
+            text->push_back(L'\n');
+        }
+    } while (__getLine(line));
+    return true;
+}
+
+PGNWriter::PGNWriter(const std::string& fileName, bool append)
+    : fmt_{ getPGNFormat(fileName) }
+    , wos_{ fileName, append ? std::ios_base::app : std::ios_base::out }
+{
+}
+
+void PGNWriter::write(Instance& instance)
+{
+    // 局间以空行分隔
+    if (gameCount_ > 0 || wos_.tellp() > 0)
+        wos_ << L'\n';
+    instance.write(wos_, fmt_);
+    wos_ << L'\n';
+    ++gameCount_;
+}
+}
@@ -105,6 +105,8 @@ Pawn::__moveSeats(const Board& board, Seat& fseat) const
 
 Pieces::Pieces()
     : allPieces_{ PieceManager::createPieces() }
+    , otherPieces_{ __getOtherPieces(allPieces_) }
+    , kindPieces_{ __getKindPieces(allPieces_) }
 {
 }
 
@@ -113,11 +115,7 @@ Pieces::getOtherPiece(const std::shared_ptr<Piece>& piece) const
 {
     if (!piece)
         return piece;
-    return allPieces_.at(
-        (std::distance(allPieces_.begin(),
-             std::find(allPieces_.begin(), allPieces_.end(), piece))
-            + allPieces_.size() / 2)
-        % allPieces_.size());
+    return otherPieces_.at(piece.get());
 }
 
 const std::vector<std::shared_ptr<Piece>>
@@ -140,6 +138,34 @@ Pieces::getBoardPieces(const std::wstring& pieceChars) const
     return pieces;
 }
 
+const std::vector<std::shared_ptr<Piece>>&
+Pieces::getKindPieces(const PieceColor color, const wchar_t name) const
+{
+    static const std::vector<std::shared_ptr<Piece>> noPieces{};
+    auto pos = kindPieces_.find({ color, name });
+    return pos == kindPieces_.end() ? noPieces : pos->second;
+}
+
+const std::unordered_map<const Piece*, std::shared_ptr<Piece>>
+Pieces::__getOtherPieces(const std::vector<std::shared_ptr<Piece>>& allPieces)
+{
+    // 红黑棋子各占一半，且排列顺序对应
+    std::unordered_map<const Piece*, std::shared_ptr<Piece>> otherPieces{};
+    int halfSize = allPieces.size() / 2;
+    for (int index = 0; index != static_cast<int>(allPieces.size()); ++index)
+        otherPieces[allPieces[index].get()] = allPieces[(index + halfSize) % allPieces.size()];
+    return otherPieces;
+}
+
+const std::map<std::pair<PieceColor, wchar_t>, std::vector<std::shared_ptr<Piece>>>
+Pieces::__getKindPieces(const std::vector<std::shared_ptr<Piece>>& allPieces)
+{
+    std::map<std::pair<PieceColor, wchar_t>, std::vector<std::shared_ptr<Piece>>> kindPieces{};
+    for (auto& piece : allPieces)
+        kindPieces[{ piece->color(), piece->name() }].push_back(piece);
+    return kindPieces;
+}
+
 const std::wstring Pieces::toString() const
 {
     std::wstringstream wss{};
@@ -214,16 +240,44 @@ const PieceColor PieceManager::getColor(const wchar_t ch)
     return islower(ch) ? PieceColor::BLACK : PieceColor::RED;
 }
 
+const PieceManager::ZhChar& PieceManager::getZhChar(const wchar_t ch)
+{
+    // 各字符串互不重复，建表一次，此后每个字符只查一次表
+    static const std::unordered_map<wchar_t, ZhChar> zhChars = []() {
+        std::unordered_map<wchar_t, ZhChar> zhChars{};
+        auto __put = [&](const std::wstring& chars, const ZhCharType type, const PieceColor color) {
+            for (int index = 0; index != static_cast<int>(chars.size()); ++index)
+                zhChars[chars[index]] = ZhChar{ type, index, color };
+        };
+        __put(preChars_, ZhCharType::PRE, PieceColor::BLACK);
+        __put(nameChars_, ZhCharType::NAME, PieceColor::BLACK);
+        __put(movChars_, ZhCharType::MOV, PieceColor::BLACK);
+        __put(numChars_.at(PieceColor::RED), ZhCharType::NUM, PieceColor::RED);
+        __put(numChars_.at(PieceColor::BLACK), ZhCharType::NUM, PieceColor::BLACK);
+        return zhChars;
+    }();
+    static const ZhChar noneChar{ ZhCharType::NONE, -1, PieceColor::BLACK };
+    auto pos = zhChars.find(ch);
+    return pos != zhChars.end() ? pos->second : noneChar;
+}
+
 const PieceColor PieceManager::getColorFromZh(const wchar_t numZh)
 {
-    return numChars_.at(PieceColor::RED).find(numZh) != std::wstring::npos
-        ? PieceColor::RED
-        : PieceColor::BLACK;
+    return getNum(PieceColor::RED, numZh) > 0 ? PieceColor::RED : PieceColor::BLACK;
 }
 
 const int PieceManager::getIndex(const int seatsLen, const bool isBottom, const wchar_t preChar)
 {
-    int index = __getPreChars(seatsLen).find(preChar);
+    // 2个：前后；3个：前中后；其余：一二三四五
+    int index{ -1 };
+    if (seatsLen == 2 || seatsLen == 3) {
+        index = __getIndex(preChar, ZhCharType::PRE);
+        if (seatsLen == 2 && index > 0)
+            index = (index == 2 ? 1 : -1);
+    } else {
+        int num{ getNum(PieceColor::RED, preChar) };
+        index = num <= 5 ? num - 1 : -1;
+    }
     return isBottom ? seatsLen - 1 - index : index;
 }
 
@@ -0,0 +1,90 @@
+#include "pipeline.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace Tools {
+
+PhaseStats::PhaseStats(const std::vector<Phase>& phases)
+    : phases_{ phases }
+    , records_(phases.size())
+{
+}
+
+void PhaseStats::add(int phase, const std::string& format, long long bytes, long long nanos)
+{
+    Record& record = records_[phase][format];
+    record.bytes += bytes;
+    record.nanos += nanos;
+    record.samples.push_back(nanos);
+}
+
+void PhaseStats::merge(const PhaseStats& other)
+{
+    for (int phase = 0; phase != static_cast<int>(records_.size()); ++phase)
+        for (auto& kv : other.records_[phase]) {
+            Record& record = records_[phase][kv.first];
+            record.bytes += kv.second.bytes;
+            record.nanos += kv.second.nanos;
+            record.samples.insert(record.samples.end(), kv.second.samples.begin(), kv.second.samples.end());
+        }
+}
+
+void PhaseStats::print(std::ostream& os, long long wallNanos) const
+{
+    os << "   总用时: " << std::fixed << std::setprecision(3) << wallNanos / 1e9 << "s\n"
+       << "   阶段    格式        文件数        KB     文件/s      MB/s   p50(ms)   p95(ms)   p99(ms)\n";
+    for (int phase = 0; phase != static_cast<int>(records_.size()); ++phase)
+        for (auto& kv : records_[phase]) {
+            const Record& record = kv.second;
+            std::vector<long long> sorted{ record.samples };
+            std::sort(sorted.begin(), sorted.end());
+            double seconds{ std::max(record.nanos, 1LL) / 1e9 };
+            os << "   " << phases_[phase].name << "    "
+               << std::left << std::setw(10) << kv.first << std::right
+               << std::setw(8) << sorted.size()
+               << std::setprecision(1) << std::setw(10) << record.bytes / 1024.0
+               << std::setw(11) << sorted.size() / seconds
+               << std::setprecision(2) << std::setw(10) << record.bytes / seconds / (1024 * 1024)
+               << std::setprecision(3) << std::setw(10) << __percentile(sorted, 50) / 1e6
+               << std::setw(10) << __percentile(sorted, 95) / 1e6
+               << std::setw(10) << __percentile(sorted, 99) / 1e6 << '\n';
+        }
+    os << std::defaultfloat << std::flush;
+}
+
+void PhaseStats::writeJSON(std::ostream& os, long long wallNanos) const
+{
+    // 键名均为ASCII(阶段键名、扩展名)，无需转义
+    os << "{\n  \"wallSeconds\": " << std::fixed << std::setprecision(6) << wallNanos / 1e9 << ",\n  \"phases\": {";
+    for (int phase = 0; phase != static_cast<int>(records_.size()); ++phase) {
+        os << (phase == 0 ? "" : ",") << "\n    \"" << phases_[phase].key << "\": {";
+        bool first{ true };
+        for (auto& kv : records_[phase]) {
+            const Record& record = kv.second;
+            std::vector<long long> sorted{ record.samples };
+            std::sort(sorted.begin(), sorted.end());
+            double seconds{ std::max(record.nanos, 1LL) / 1e9 };
+            os << (first ? "" : ",") << "\n      \"" << kv.first << "\": { \"files\": " << sorted.size()
+               << ", \"bytes\": " << record.bytes << ", \"seconds\": " << record.nanos / 1e9
+               << ", \"filesPerSecond\": " << sorted.size() / seconds
+               << ", \"bytesPerSecond\": " << record.bytes / seconds
+               << ", \"p50Ms\": " << __percentile(sorted, 50) / 1e6
+               << ", \"p95Ms\": " << __percentile(sorted, 95) / 1e6
+               << ", \"p99Ms\": " << __percentile(sorted, 99) / 1e6 << " }";
+            first = false;
+        }
+        os << (first ? "}" : "\n    }");
+    }
+    os << "\n  }\n}\n"
+       << std::defaultfloat;
+}
+
+// 最近秩法：不小于percent%样本的最小值
+long long PhaseStats::__percentile(const std::vector<long long>& sorted, int percent)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank{ (sorted.size() * percent + 99) / 100 };
+    return sorted[std::max(rank, size_t{ 1 }) - 1];
+}
+}
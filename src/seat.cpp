@@ -1,5 +1,6 @@
 #include "seat.h"
 #include "board.h"
+#include "instance.h"
 #include "piece.h"
 #include <algorithm>
 #include <cassert>
@@ -37,6 +38,13 @@ Seat::getMoveSeats(const Board& board)
     return std::vector<std::shared_ptr<Seat>>{ seats.begin(), pos };
 }
 
+void Seat::put(const std::shared_ptr<Piece>& piece)
+{
+    if (piece)
+        piece->setRowcol(rowcol());
+    piece_ = piece;
+}
+
 const std::shared_ptr<Piece>
 Seat::movTo(Seat& tseat, const std::shared_ptr<Piece>& fillPiece)
 {
@@ -53,8 +61,9 @@ const std::wstring Seat::toString() const
     return wss.str();
 }
 
-Seats::Seats()
+Seats::Seats(const std::shared_ptr<Pieces>& pieces)
     : allSeats_{ SeatManager::creatSeats() }
+    , pieces_{ pieces }
 {
 }
 
@@ -76,7 +85,8 @@ Seats::getKingSeat(const PieceColor color) const
             auto& piece = seat->piece();
             return piece && piece->color() == color && PieceManager::isKing(piece->name());
         });
-    assert(pos != allSeats_.end());
+    if (pos == allSeats_.end())
+        throw InstanceSpace::ParseError("棋盘上缺少将(帅)");
     return *pos;
 }
 
@@ -84,14 +94,35 @@ const std::vector<std::shared_ptr<Seat>>
 Seats::getLiveSeats(const PieceColor color, const wchar_t name, const int col, bool getStronge) const
 {
     std::vector<std::shared_ptr<Seat>> seats{};
-    std::copy_if(allSeats_.begin(), allSeats_.end(), std::back_inserter(seats),
-        [&](const std::shared_ptr<Seat>& seat) {
-            auto& piece = seat->piece();
-            return piece && color == piece->color()
-                && (name == L'\x0' || name == piece->name())
-                && (col == -1 || col == seat->col())
-                && (!getStronge || PieceManager::isStronge(piece->name()));
-        });
+    auto __isLive = [&](const std::shared_ptr<Seat>& seat) {
+        auto& piece = seat->piece();
+        return piece && color == piece->color()
+            && (!getStronge || PieceManager::isStronge(piece->name()));
+    };
+    if (col < -1 || col >= SeatManager::ColNum())
+        throw InstanceSpace::ParseError("着法所指的列超出棋盘");
+    if (name != L'\x0') { // 指定棋子名时只查该种棋子，按位置顺序排列
+        if (getStronge && !PieceManager::isStronge(name))
+            return seats;
+        for (auto& piece : pieces_->getKindPieces(color, name)) {
+            if (piece->rowcol() < 0)
+                continue;
+            auto& seat = getSeat(piece->rowcol());
+            if (seat->piece() == piece && (col == -1 || seat->col() == col))
+                seats.push_back(seat);
+        }
+        std::sort(seats.begin(), seats.end(),
+            [](const std::shared_ptr<Seat>& aseat, const std::shared_ptr<Seat>& bseat) {
+                return aseat->rowcol() < bseat->rowcol();
+            });
+    } else if (col == -1)
+        std::copy_if(allSeats_.begin(), allSeats_.end(), std::back_inserter(seats), __isLive);
+    else // 指定列时只查该列的位置
+        for (int row = 0; row != SeatManager::RowNum(); ++row) {
+            auto& seat = getSeat(row, col);
+            if (__isLive(seat))
+                seats.push_back(seat);
+        }
     return seats;
 }
 
@@ -128,17 +159,23 @@ void Seats::reset(const std::vector<std::shared_ptr<Piece>>& boardPieces)
 
 void Seats::changeSide(const ChangeType ct, const std::shared_ptr<Pieces>& pieces)
 {
-    std::vector<std::shared_ptr<Piece>> boardPieces{};
+    if (ct == ChangeType::EXCHANGE) {
+        for (auto& seat : allSeats_)
+            seat->put(pieces->getOtherPiece(seat->piece()));
+        return;
+    }
     auto changeRowcol = (ct == ChangeType::ROTATE
             ? &SeatManager::getRotate
             : &SeatManager::getSymmetry);
-    std::for_each(allSeats_.begin(), allSeats_.end(),
-        [&](const std::shared_ptr<Seat>& seat) {
-            boardPieces.push_back(ct == ChangeType::EXCHANGE
-                    ? pieces->getOtherPiece(seat->piece())
-                    : getSeat(changeRowcol(seat->rowcol()))->piece());
-        });
-    reset(boardPieces);
+    // 旋转、对称均为成对位置互换，原地交换棋子即可
+    for (auto& seat : allSeats_) {
+        auto& othSeat = getSeat(changeRowcol(seat->rowcol()));
+        if (SeatManager::getIndex(seat->rowcol()) < SeatManager::getIndex(othSeat->rowcol())) {
+            auto piece = seat->piece();
+            seat->put(othSeat->piece());
+            othSeat->put(piece);
+        }
+    }
 }
 
 const std::wstring Seats::getPieceChars() const
@@ -4,7 +4,30 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <codecvt>
+#include <locale>
+#include <iterator>
+#include <atomic>
+#include <cerrno>
+#include <thread>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
 #include <io.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+#endif
 using namespace std;
 
 
@@ -47,7 +70,7 @@ wstring Tools::s2ws(const string& s)
 {
     const char* str = s.c_str();
     size_t len = s.size() + 1;
-    wchar_t *wstr = new wchar_t[len];
+    wchar_t *wstr = new wchar_t[len]();
     mbstowcs(wstr, str, len);
     wstring ret(wstr);
     delete [] wstr;
@@ -58,17 +81,55 @@ wstring Tools::s2ws(const string& s)
 string Tools::ws2s(const wstring& ws)
 {
     const wchar_t* wstr = ws.c_str();
-    size_t len = 2 * ws.size() + 1;
-    char *str = new char[len];
+    size_t len = wcstombs(nullptr, wstr, 0); // 多字节长度随编码而定
+    len = (len == static_cast<size_t>(-1) ? 2 * ws.size() : len) + 1;
+    char *str = new char[len]();
     wcstombs(str, wstr, len);
     string ret(str);
     delete [] str;
     return ret;
 }
 
+//wstring与UTF-8字节流互相转换，不依赖当前区域设置
+string Tools::ws2u8(const wstring& ws)
+{
+    return wstring_convert<codecvt_utf8<wchar_t>>{}.to_bytes(ws);
+}
+
+wstring Tools::u82ws(const string& s)
+{
+    return wstring_convert<codecvt_utf8<wchar_t>>{}.from_bytes(s);
+}
+
+wstring Tools::decode(const string& s)
+{
+    auto& cvt = use_facet<codecvt<wchar_t, char, mbstate_t>>(locale());
+    mbstate_t state{};
+    wstring ws(s.size(), L'\0');
+    const char* fromNext{};
+    wchar_t* toNext{};
+    cvt.in(state, s.data(), s.data() + s.size(), fromNext, &ws[0], &ws[0] + ws.size(), toNext);
+    ws.resize(toNext - &ws[0]);
+    return ws;
+}
+
+string Tools::encode(const wstring& ws)
+{
+    auto& cvt = use_facet<codecvt<wchar_t, char, mbstate_t>>(locale());
+    mbstate_t state{};
+    string s(ws.size() * max(cvt.max_length(), 1), '\0');
+    const wchar_t* fromNext{};
+    char* toNext{};
+    cvt.out(state, ws.data(), ws.data() + ws.size(), fromNext, &s[0], &s[0] + s.size(), toNext);
+    s.resize(toNext - &s[0]);
+    return s;
+}
+
 const string Tools::getExt(const string& filename)
 {
-    string ext{ filename.substr(filename.rfind('.')) };
+    // 只在最后一级文件名中查找，目录名中的'.'不算
+    size_t pos{ filename.rfind('.') }, sep{ filename.find_last_of("/\\") };
+    string ext{ pos == string::npos || (sep != string::npos && pos < sep) ? "" : filename.substr(pos) }; // 无扩展名时为空
     for (auto& c : ext)
         c = tolower(c);
     return ext;
@@ -96,19 +157,91 @@ void Tools::writeTxt(const string& fileName, const wstring& ws)
 
 void Tools::getFiles(const string& path, vector<string>& files)
 {
+    vector<string> names{}, dirs{};
+    getEntries(path, names, dirs);
+    for (auto& name : names) //如果不是目录,加入列表
+        files.push_back(path + "/" + name);
+    for (auto& dir : dirs) //如果是目录,迭代之
+        getFiles(path + "/" + dir, files);
+}
+
+void Tools::getEntries(const string& path, vector<string>& files, vector<string>& dirs)
+{
+    auto __add = [&](const string& name, bool isDir) {
+        if (name == "." || name == "..")
+            return;
+        (isDir ? dirs : files).push_back(name);
+    };
+#ifdef _WIN32
     long hFile = 0; //文件句柄
     struct _finddata_t fileinfo; //文件信息
-    string p{};
-    if ((hFile = _findfirst(p.assign(path).append("\\*").c_str(), &fileinfo)) != -1) {
-        do { //如果是目录,迭代之  //如果不是,加入列表
-            if (fileinfo.attrib & _A_SUBDIR) {
-                if (strcmp(fileinfo.name, ".") != 0 && strcmp(fileinfo.name, "..") != 0)
-                    getFiles(p.assign(path).append("\\").append(fileinfo.name), files);
-            } else
-                files.push_back(p.assign(path).append("\\").append(fileinfo.name));
-        } while (_findnext(hFile, &fileinfo) == 0);
+    if ((hFile = _findfirst((path + "/*").c_str(), &fileinfo)) != -1) {
+        do
+            __add(fileinfo.name, fileinfo.attrib & _A_SUBDIR);
+        while (_findnext(hFile, &fileinfo) == 0);
         _findclose(hFile);
     }
+#else
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return;
+    while (struct dirent* entry = readdir(dir)) {
+        struct stat st {};
+        string name{ entry->d_name };
+        if (stat((path + "/" + name).c_str(), &st) == 0)
+            __add(name, S_ISDIR(st.st_mode));
+    }
+    closedir(dir);
+#endif
+}
+
+bool Tools::makeDir(const string& path)
+{
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+bool Tools::getFileStat(const string& fileName, long long& size, long long& mtime)
+{
+    struct stat st {};
+    if (stat(fileName.c_str(), &st) != 0)
+        return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+uint64_t Tools::getHash(const char* data, size_t size)
+{
+    uint64_t hash{ 14695981039346656037ULL };
+    for (size_t i = 0; i != size; ++i)
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    return hash;
+}
+
+void Tools::parallelFor(int count, int threadCount, const function<void(int, int)>& func)
+{
+    if (threadCount <= 0)
+        threadCount = max(1, static_cast<int>(thread::hardware_concurrency()));
+    threadCount = min(threadCount, max(count, 1));
+    atomic<int> nextIndex{ 0 };
+    auto __work = [&](int workerNo) {
+        for (int index = nextIndex++; index < count; index = nextIndex++)
+            func(index, workerNo);
+    };
+    if (threadCount == 1) {
+        __work(0);
+        return;
+    }
+    vector<thread> threads{};
+    for (int workerNo = 1; workerNo != threadCount; ++workerNo)
+        threads.emplace_back(__work, workerNo);
+    __work(0); // 当前线程也领取任务
+    for (auto& th : threads)
+        th.join();
 }
 
 /*****************************************************************************************
@@ -152,6 +285,174 @@ int Tools::copyFile(const char* SourceFile, const char* NewFile)
     //}
 }
 
+bool Tools::copyFile(const string& sourceFile, const string& newFile, CopyMode mode)
+{
+    if (mode == CopyMode::STREAM)
+        return copyFile(sourceFile.c_str(), newFile.c_str()) == 1;
+#ifdef _WIN32
+    if (mode == CopyMode::HARDLINK) {
+        DeleteFileA(newFile.c_str());
+        if (CreateHardLinkA(newFile.c_str(), sourceFile.c_str(), NULL))
+            return true;
+    }
+    return CopyFileA(sourceFile.c_str(), newFile.c_str(), FALSE) || copyFile(sourceFile.c_str(), newFile.c_str()) == 1;
+#else
+    if (mode == CopyMode::HARDLINK) {
+        unlink(newFile.c_str()); // 已有的输出文件先删除，否则链接失败
+        if (link(sourceFile.c_str(), newFile.c_str()) == 0)
+            return true;
+    }
+    int in = open(sourceFile.c_str(), O_RDONLY);
+    if (in == -1)
+        return false;
+    struct stat st {};
+    int out{ -1 };
+    if (fstat(in, &st) != 0 || (out = open(newFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        close(in);
+        return false;
+    }
+    bool copied{ false };
+#ifdef __linux__
+#ifdef FICLONE
+    if (mode != CopyMode::KERNEL)
+        copied = ioctl(out, FICLONE, in) == 0;
+#endif
+    // copy_file_range同一文件系统内可不经页缓存；不支持时退回sendfile，每次最多复制约2GB
+    off_t remain{ st.st_size };
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    for (ssize_t count{ 0 }; !copied && remain > 0; remain -= count)
+        if ((count = copy_file_range(in, nullptr, out, nullptr, remain, 0)) <= 0)
+            break;
+    copied = copied || remain == 0;
+#endif
+    if (!copied && lseek(in, st.st_size - remain, SEEK_SET) != -1) {
+        for (ssize_t count{ 0 }; remain > 0; remain -= count)
+            if ((count = sendfile(out, in, nullptr, remain)) <= 0)
+                break;
+        copied = remain == 0;
+    }
+#endif
+    close(in);
+    close(out);
+    return copied || copyFile(sourceFile.c_str(), newFile.c_str()) == 1;
+#endif
+}
+
+bool Tools::renameFile(const string& oldFile, const string& newFile)
+{
+#ifdef _WIN32
+    return MoveFileExA(oldFile.c_str(), newFile.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(oldFile.c_str(), newFile.c_str()) == 0;
+#endif
+}
+
+Tools::Journal::Journal(const string& fileName, int syncCount, int syncMillis)
+    : file_{ fopen(fileName.c_str(), "ab+") }
+    , syncCount_{ syncCount }
+    , syncMillis_{ syncMillis }
+{
+    if (file_ && fseek(file_, -1, SEEK_END) == 0) {
+        bool complete{ fgetc(file_) == '\n' };
+        fseek(file_, 0, SEEK_END); // 读写之间须重新定位
+        if (!complete)
+            fputc('\n', file_);
+    }
+}
+
+void Tools::Journal::append(const string& line)
+{
+    if (!file_)
+        return;
+    fwrite(line.data(), 1, line.size(), file_);
+    fputc('\n', file_);
+    if (++pending_ >= syncCount_
+        || chrono::steady_clock::now() - lastSync_ >= chrono::milliseconds(syncMillis_))
+        sync();
+}
+
+void Tools::Journal::sync()
+{
+    if (!file_ || pending_ == 0)
+        return;
+    fflush(file_);
+#ifdef _WIN32
+    _commit(_fileno(file_));
+#else
+    fsync(fileno(file_));
+#endif
+    pending_ = 0;
+    lastSync_ = chrono::steady_clock::now();
+}
+
+void Tools::Journal::close()
+{
+    if (!file_)
+        return;
+    sync();
+    fclose(file_);
+    file_ = nullptr;
+}
+
+Tools::FileMap::FileMap(const string& fileName)
+{
+#ifdef _WIN32
+    HANDLE hFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER fileSize{};
+        HANDLE hMapping{ NULL };
+        if (GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0
+            && (hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL) {
+            data_ = static_cast<const char*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(hMapping); // 视图保持对映射的引用
+            if (data_) {
+                size_ = static_cast<size_t>(fileSize.QuadPart);
+                mapping_ = const_cast<char*>(data_);
+            }
+        }
+        CloseHandle(hFile);
+    }
+#else
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd != -1) {
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                data_ = static_cast<const char*>(addr);
+                size_ = st.st_size;
+                mapping_ = addr;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if (!mapping_) { // 映射失败（如空文件、管道），读入内存
+        ifstream ifs(fileName, ios_base::binary);
+        buffer_.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+}
+
+Tools::FileMap::FileMap(const char* data, size_t size)
+    : data_{ data }
+    , size_{ size }
+{
+}
+
+Tools::FileMap::~FileMap()
+{
+    if (!mapping_)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapping_);
+#else
+    munmap(mapping_, size_);
+#endif
+}
+
 // 测试
 const wstring Tools::test()
 {